@@ -4,4 +4,6 @@
 
 #include "CoreMinimal.h"
 
-DECLARE_LOG_CATEGORY_EXTERN(LogPicross, Log, All);
\ No newline at end of file
+DECLARE_LOG_CATEGORY_EXTERN(LogPicross, Log, All);
+
+DECLARE_STATS_GROUP(TEXT("Picross"), STATGROUP_Picross, STATCAT_Advanced);
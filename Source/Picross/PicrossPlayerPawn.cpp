@@ -17,7 +17,8 @@ TAutoConsoleVariable<bool> CVarDebugInputTraces(
 APicrossPlayerPawn::APicrossPlayerPawn()
 	: TraceMaxDistance(10000.f),
 	  TraceSphereRadius(1.f),
-	  TraceChannel(ECC_Visibility)
+	  TraceChannel(ECC_Visibility),
+	  bUseGridTraces(true)
 {
 	PrimaryActorTick.bCanEverTick = true;
 }
@@ -116,6 +117,30 @@ APuzzleBlockAvatar* APicrossPlayerPawn::TraceForBlockAvatar(FVector WorldPositio
 		return nullptr;
 	}
 
+	if (bUseGridTraces)
+	{
+		APuzzleGrid* PuzzleGrid = UPicrossGameplayStatics::GetPuzzleGrid(this);
+		if (!PuzzleGrid)
+		{
+			return nullptr;
+		}
+
+		FIntVector HitPosition;
+		APuzzleBlockAvatar* HitBlock = PuzzleGrid->TraceForBlock(WorldPosition, WorldDirection, TraceMaxDistance,
+		                                                          HitPosition);
+
+#if ENABLE_DRAW_DEBUG
+		if (HitBlock && CVarDebugInputTraces.GetValueOnAnyThread())
+		{
+			DrawDebugPoint(GetWorld(), HitBlock->GetActorLocation(), 8.f, FColor::Red, false, 3.f);
+			DrawDebugString(GetWorld(), HitBlock->GetActorLocation(), HitPosition.ToString(),
+			                nullptr, FColor::White, 3.f);
+		}
+#endif
+
+		return HitBlock;
+	}
+
 	const FVector Start = WorldPosition;
 	const FVector End = WorldPosition + WorldDirection.GetSafeNormal() * TraceMaxDistance;
 
@@ -143,6 +168,12 @@ APuzzleBlockAvatar* APicrossPlayerPawn::TraceForBlockAvatar(FVector WorldPositio
 		{
 			return HitBlock;
 		}
+
+		// instanced blocks are drawn by the grid, find the block for the hit instance
+		if (const APuzzleGrid* HitGrid = Cast<APuzzleGrid>(Hit.Actor.Get()))
+		{
+			return HitGrid->GetBlockAtInstance(Hit.Component.Get(), Hit.Item);
+		}
 	}
 	return nullptr;
 }
@@ -27,6 +27,13 @@ public:
 	UPROPERTY(EditDefaultsOnly, BlueprintReadWrite)
 	TEnumAsByte<ECollisionChannel> TraceChannel;
 
+	/**
+	 * If true, find blocks by walking the cells of the puzzle grid along the trace,
+	 * instead of using a physics sweep. This doesn't require blocks to have collision.
+	 */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadWrite)
+	bool bUseGridTraces;
+
 	/**
 	 * Action input names for each block type that can be identified.
 	 */
@@ -0,0 +1,177 @@
+﻿// Copyright Bohdon Sayre.
+
+
+#include "PuzzleAnnotationMinimizer.h"
+
+#include "Picross.h"
+#include "Async/ParallelFor.h"
+
+
+DECLARE_CYCLE_STAT(TEXT("Minimize Annotations"), STAT_PicrossMinimizeAnnotations, STATGROUP_Picross);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Annotation Minimizer Trials"), STAT_PicrossAnnotationMinimizerTrials, STATGROUP_Picross);
+
+
+FPuzzleAnnotationMinimizer::FPuzzleAnnotationMinimizer()
+	: Difficulty(1.f),
+	  Seed(0),
+	  BatchSize(FMath::Max(FPlatformMisc::NumberOfCoresIncludingHyperthreads(), 1)),
+	  NumRowsHidden(0),
+	  NumTrials(0)
+{
+}
+
+bool FPuzzleAnnotationMinimizer::Minimize(const FPuzzleAnnotations& InAnnotations,
+                                          FPuzzleAnnotations& OutAnnotations)
+{
+	SCOPE_CYCLE_COUNTER(STAT_PicrossMinimizeAnnotations);
+
+	NumRowsHidden = 0;
+	NumTrials = 0;
+
+	OutAnnotations = InAnnotations;
+
+	TArray<int32> CandidateRowIds;
+	for (int32 Axis = 0; Axis <= 2; ++Axis)
+	{
+		TArray<FPuzzleRowAnnotations>& AxisAnnotations = OutAnnotations.GetAxisRowAnnotations(Axis);
+		for (int32 RowIndex = 0; RowIndex < AxisAnnotations.Num(); ++RowIndex)
+		{
+			AxisAnnotations[RowIndex].bIsVisible = true;
+			CandidateRowIds.Add(FPuzzleRow::MakeRowId(Axis, RowIndex));
+		}
+	}
+
+	FPuzzleSolver Solver;
+	Solver.SetRecordSteps(false);
+	if (!Solver.Initialize(OutAnnotations))
+	{
+		return false;
+	}
+
+	// trial solvers start with every row visible, and the locked solver with none
+	TrialSolvers.Init(Solver, FMath::Max(BatchSize, 1));
+	LockedSolver = Solver;
+	for (const int32 RowId : CandidateRowIds)
+	{
+		LockedSolver.SetRowVisible(RowId, false);
+	}
+	LockedCellDomains = Solver.GetCellDomains();
+
+	++NumTrials;
+	if (!Solver.SolvePuzzle())
+	{
+		INC_DWORD_STAT_BY(STAT_PicrossAnnotationMinimizerTrials, NumTrials);
+		return false;
+	}
+
+	FRandomStream RandomStream(Seed);
+	for (int32 Idx = CandidateRowIds.Num() - 1; Idx > 0; --Idx)
+	{
+		CandidateRowIds.Swap(Idx, RandomStream.RandRange(0, Idx));
+	}
+
+	const int32 TargetRowsHidden = FMath::CeilToInt(FMath::Clamp(Difficulty, 0.f, 1.f) * CandidateRowIds.Num());
+
+	TArray<bool> BatchSolved;
+	TArray<int32> SolvedRowIds;
+	TArray<int32> UnsolvedRowIds;
+	int32 NextCandidateIdx = 0;
+	while (NextCandidateIdx < CandidateRowIds.Num() && NumRowsHidden < TargetRowsHidden)
+	{
+		// try hiding each row of the batch on its own
+		const int32 BatchStartIdx = NextCandidateIdx;
+		const int32 BatchNum = FMath::Min(TrialSolvers.Num(), CandidateRowIds.Num() - BatchStartIdx);
+		NextCandidateIdx += BatchNum;
+
+		BatchSolved.SetNumUninitialized(BatchNum);
+		ParallelFor(BatchNum, [this, &CandidateRowIds, &BatchSolved, BatchStartIdx](int32 Idx)
+		{
+			BatchSolved[Idx] = TrySolveWithoutRows(TrialSolvers[Idx],
+			                                       MakeArrayView(&CandidateRowIds[BatchStartIdx + Idx], 1));
+		});
+		NumTrials += BatchNum;
+
+		SolvedRowIds.Reset();
+		UnsolvedRowIds.Reset();
+		for (int32 Idx = 0; Idx < BatchNum; ++Idx)
+		{
+			(BatchSolved[Idx] ? SolvedRowIds : UnsolvedRowIds).Add(CandidateRowIds[BatchStartIdx + Idx]);
+		}
+
+		// rows that are needed now will still be needed once more rows are hidden
+		LockRows(UnsolvedRowIds);
+
+		SolvedRowIds.SetNum(FMath::Min(SolvedRowIds.Num(), TargetRowsHidden - NumRowsHidden));
+
+		if (SolvedRowIds.Num() > 1)
+		{
+			// each row can be hidden on its own, but maybe not together. if not, hide only the first
+			// and try the others again later, now that it's hidden.
+			++NumTrials;
+			if (!TrySolveWithoutRows(TrialSolvers[0], SolvedRowIds))
+			{
+				CandidateRowIds.Insert(&SolvedRowIds[1], SolvedRowIds.Num() - 1, NextCandidateIdx);
+				SolvedRowIds.SetNum(1);
+			}
+		}
+
+		for (const int32 RowId : SolvedRowIds)
+		{
+			HideRow(RowId, OutAnnotations);
+		}
+	}
+
+	INC_DWORD_STAT_BY(STAT_PicrossAnnotationMinimizerTrials, NumTrials);
+	UE_LOG(LogPicross, Verbose, TEXT("Hid %d of %d rows in %d trials"), NumRowsHidden, CandidateRowIds.Num(),
+	       NumTrials);
+
+	return true;
+}
+
+bool FPuzzleAnnotationMinimizer::TrySolveWithoutRows(FPuzzleSolver& Solver, TArrayView<const int32> RowIds)
+{
+	for (const int32 RowId : RowIds)
+	{
+		Solver.SetRowVisible(RowId, false);
+	}
+
+	// cells deduced from rows that stay visible will be deduced again, so start with them
+	Solver.SetCellDomains(LockedCellDomains);
+	const bool bSolved = Solver.SolvePuzzle();
+
+	for (const int32 RowId : RowIds)
+	{
+		Solver.SetRowVisible(RowId, true);
+	}
+
+	return bSolved;
+}
+
+void FPuzzleAnnotationMinimizer::LockRows(const TArray<int32>& RowIds)
+{
+	if (RowIds.Num() == 0)
+	{
+		return;
+	}
+
+	for (const int32 RowId : RowIds)
+	{
+		LockedSolver.SetRowVisible(RowId, true);
+	}
+
+	LockedSolver.SetCellDomains(LockedCellDomains);
+	LockedSolver.SolvePuzzle();
+	LockedCellDomains = LockedSolver.GetCellDomains();
+}
+
+void FPuzzleAnnotationMinimizer::HideRow(int32 RowId, FPuzzleAnnotations& OutAnnotations)
+{
+	for (FPuzzleSolver& Solver : TrialSolvers)
+	{
+		Solver.SetRowVisible(RowId, false);
+	}
+
+	TArray<FPuzzleRowAnnotations>& AxisAnnotations = OutAnnotations.GetAxisRowAnnotations(FPuzzleRow::GetRowIdAxis(RowId));
+	AxisAnnotations[FPuzzleRow::GetRowIdAxisRowIndex(RowId)].bIsVisible = false;
+	++NumRowsHidden;
+}
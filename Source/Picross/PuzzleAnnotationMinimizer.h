@@ -0,0 +1,74 @@
+﻿// Copyright Bohdon Sayre.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "PuzzleSolver.h"
+#include "PuzzleTypes.h"
+
+
+/**
+ * Hides as many row annotations of a puzzle as possible, while keeping it fully solvable by deduction.
+ *
+ * Rows are tried in a random order from a seed, hiding each row if the solver can still solve the puzzle
+ * without it. Hiding rows only ever removes information, so a row that can't be hidden is never tried again.
+ * Rows are tried in parallel batches, and each trial starts from the cells deduced from the rows known
+ * to stay visible, instead of from scratch.
+ */
+class PICROSS_API FPuzzleAnnotationMinimizer
+{
+public:
+	FPuzzleAnnotationMinimizer();
+
+	/**
+	 * The fraction of all rows to try to hide, from 0 hiding nothing to 1 hiding as many rows as possible.
+	 * Higher values make puzzles harder, since fewer rows can be used to deduce each cell.
+	 */
+	float Difficulty;
+
+	/** The seed used to decide the order in which rows are tried */
+	int32 Seed;
+
+	/** The number of rows to try in parallel */
+	int32 BatchSize;
+
+	/**
+	 * Hide row annotations of a puzzle.
+	 * @param InAnnotations The annotations generated for the puzzle. Visibility is ignored, every row starts visible.
+	 * @param OutAnnotations The annotations with rows hidden
+	 * @return False if the puzzle cannot be solved by deduction even with every row visible
+	 */
+	bool Minimize(const FPuzzleAnnotations& InAnnotations, FPuzzleAnnotations& OutAnnotations);
+
+	/** Return the number of rows hidden by the last call to Minimize */
+	FORCEINLINE int32 GetNumRowsHidden() const { return NumRowsHidden; }
+
+	/** Return the number of times the puzzle was solved during the last call to Minimize */
+	FORCEINLINE int32 GetNumTrials() const { return NumTrials; }
+
+protected:
+	/** The number of rows hidden by the last minimize */
+	int32 NumRowsHidden;
+
+	/** The number of solves during the last minimize */
+	int32 NumTrials;
+
+	/** One solver per batch slot, each with the currently hidden rows hidden */
+	TArray<FPuzzleSolver> TrialSolvers;
+
+	/** Solver with only the rows that must stay visible */
+	FPuzzleSolver LockedSolver;
+
+	/** The cells deduced from only the rows that must stay visible, the starting point of every trial */
+	TArray<uint16> LockedCellDomains;
+
+	/** Return true if the puzzle can be solved by a trial solver with its visible rows, and some rows hidden */
+	bool TrySolveWithoutRows(FPuzzleSolver& Solver, TArrayView<const int32> RowIds);
+
+	/** Mark rows as needing to stay visible, and update the cells deduced from them */
+	void LockRows(const TArray<int32>& RowIds);
+
+	/** Hide a row in every trial solver and the output annotations */
+	void HideRow(int32 RowId, FPuzzleAnnotations& OutAnnotations);
+};
@@ -0,0 +1,183 @@
+﻿// Copyright Bohdon Sayre.
+
+
+#include "PuzzleAsyncSolver.h"
+
+#include "Picross.h"
+#include "Async/Async.h"
+
+
+DECLARE_CYCLE_STAT(TEXT("Async Solve Puzzle"), STAT_PicrossAsyncSolvePuzzle, STATGROUP_Picross);
+
+
+/** The minimum change in progress to report to the game thread */
+static constexpr float PuzzleAsyncSolverProgressStep = 0.05f;
+
+
+FPuzzleAsyncSolver::FPuzzleAsyncSolver()
+	: bIsWorkerRunning(false),
+	  CompletedRequestId(0),
+	  LastReportedProgress(0.f)
+{
+}
+
+int32 FPuzzleAsyncSolver::Submit(const FPuzzleDef& PuzzleDef, const FPuzzleAnnotations& Annotations,
+                                 bool bCheckUniqueness)
+{
+	check(IsInGameThread());
+
+	const int32 RequestId = LatestRequestId.Increment();
+
+	FScopeLock Lock(&CriticalSection);
+
+	// replaces any older snapshot that hasn't started yet
+	PendingRequest = FRequest{RequestId, PuzzleDef, Annotations, bCheckUniqueness};
+
+	// the result of the request being solved would be discarded
+	if (ActiveChecker.IsValid())
+	{
+		ActiveChecker->Cancel();
+	}
+
+	if (!bIsWorkerRunning)
+	{
+		bIsWorkerRunning = true;
+
+		TSharedRef<FPuzzleAsyncSolver, ESPMode::ThreadSafe> This = AsShared();
+		FFunctionGraphTask::CreateAndDispatchWhenReady([This]()
+		{
+			This->ProcessRequests();
+		}, TStatId(), nullptr, ENamedThreads::AnyBackgroundThreadNormalTask);
+	}
+
+	return RequestId;
+}
+
+void FPuzzleAsyncSolver::Cancel()
+{
+	check(IsInGameThread());
+
+	CompletedRequestId = LatestRequestId.Increment();
+
+	FScopeLock Lock(&CriticalSection);
+
+	PendingRequest.Reset();
+
+	if (ActiveChecker.IsValid())
+	{
+		ActiveChecker->Cancel();
+	}
+}
+
+void FPuzzleAsyncSolver::ProcessRequests()
+{
+	while (true)
+	{
+		TSharedRef<FPuzzleUniquenessChecker, ESPMode::ThreadSafe> Checker =
+			MakeShared<FPuzzleUniquenessChecker, ESPMode::ThreadSafe>();
+		FRequest Request;
+		{
+			FScopeLock Lock(&CriticalSection);
+
+			if (!PendingRequest.IsSet())
+			{
+				ActiveChecker.Reset();
+				bIsWorkerRunning = false;
+				return;
+			}
+
+			Request = MoveTemp(PendingRequest.GetValue());
+			PendingRequest.Reset();
+			ActiveChecker = Checker;
+		}
+
+		ProcessRequest(Request, Checker.Get());
+	}
+}
+
+void FPuzzleAsyncSolver::ProcessRequest(const FRequest& Request, FPuzzleUniquenessChecker& Checker)
+{
+	if (!IsLatestRequest(Request.RequestId))
+	{
+		return;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_PicrossAsyncSolvePuzzle);
+
+	LastReportedProgress = 0.f;
+
+	FPuzzleAsyncSolveResult Result;
+	Result.RequestId = Request.RequestId;
+
+	FPuzzleSolver Solver;
+	if (Solver.Initialize(Request.Annotations))
+	{
+		Solver.SolvePuzzle();
+	}
+	Result.SolverResult = Solver.GetResult();
+	Solver.GetSolution(Result.Solution);
+
+	if (Request.bCheckUniqueness)
+	{
+		switch (Result.SolverResult.State)
+		{
+		case EPuzzleSolverState::Solved:
+			// deductions alone can only reach one solution
+			Result.Uniqueness = EPuzzleUniqueness::Unique;
+			break;
+		case EPuzzleSolverState::Contradiction:
+			Result.Uniqueness = EPuzzleUniqueness::Unsolvable;
+			break;
+		default:
+			Checker.OnProgress = [this, RequestId = Request.RequestId](float Progress)
+			{
+				ReportProgress(RequestId, Progress);
+			};
+			Result.Uniqueness = Checker.Check(Request.Annotations, &Request.PuzzleDef);
+			Result.AmbiguousCells = Checker.GetAmbiguousCells();
+
+			if (Checker.IsCancelled())
+			{
+				return;
+			}
+			break;
+		}
+	}
+
+	if (!IsLatestRequest(Request.RequestId))
+	{
+		return;
+	}
+
+	ReportProgress(Request.RequestId, 1.f);
+
+	TWeakPtr<FPuzzleAsyncSolver, ESPMode::ThreadSafe> WeakThis = AsShared();
+	AsyncTask(ENamedThreads::GameThread, [WeakThis, Result = MoveTemp(Result)]()
+	{
+		TSharedPtr<FPuzzleAsyncSolver, ESPMode::ThreadSafe> This = WeakThis.Pin();
+		if (This.IsValid() && This->IsLatestRequest(Result.RequestId))
+		{
+			This->CompletedRequestId = Result.RequestId;
+			This->OnSolvedEvent.Broadcast(Result);
+		}
+	});
+}
+
+void FPuzzleAsyncSolver::ReportProgress(int32 RequestId, float Progress)
+{
+	if (Progress < 1.f && Progress - LastReportedProgress < PuzzleAsyncSolverProgressStep)
+	{
+		return;
+	}
+	LastReportedProgress = Progress;
+
+	TWeakPtr<FPuzzleAsyncSolver, ESPMode::ThreadSafe> WeakThis = AsShared();
+	AsyncTask(ENamedThreads::GameThread, [WeakThis, RequestId, Progress]()
+	{
+		TSharedPtr<FPuzzleAsyncSolver, ESPMode::ThreadSafe> This = WeakThis.Pin();
+		if (This.IsValid() && This->IsLatestRequest(RequestId))
+		{
+			This->OnProgressEvent.Broadcast(RequestId, Progress);
+		}
+	});
+}
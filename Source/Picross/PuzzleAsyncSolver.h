@@ -0,0 +1,117 @@
+﻿// Copyright Bohdon Sayre.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "PuzzleSolver.h"
+#include "PuzzleTypes.h"
+#include "HAL/ThreadSafeCounter.h"
+
+
+/**
+ * The results of solving a puzzle in the background
+ */
+struct PICROSS_API FPuzzleAsyncSolveResult
+{
+	FPuzzleAsyncSolveResult()
+		: RequestId(0),
+		  Uniqueness(EPuzzleUniqueness::Unknown)
+	{
+	}
+
+	/** The id returned when the puzzle was submitted */
+	int32 RequestId;
+
+	/** The results of solving using only deductions from the annotations */
+	FPuzzleSolverResult SolverResult;
+
+	/** The puzzle built from the deduced cells. Unknown cells are left empty. */
+	FPuzzleDef Solution;
+
+	/** Whether the annotations have exactly one solution, unknown if uniqueness was not checked */
+	EPuzzleUniqueness Uniqueness;
+
+	/** The cells that differ between two solutions, if the annotations are ambiguous */
+	TArray<FIntVector> AmbiguousCells;
+};
+
+
+/**
+ * Solves puzzles on a background task, reporting progress and results on the game thread.
+ *
+ * Submitting a puzzle replaces any puzzle waiting to be solved, and stops the one being solved,
+ * so that only the latest snapshot is solved and reported. Submit and Cancel must be called on the game thread.
+ */
+class PICROSS_API FPuzzleAsyncSolver : public TSharedFromThis<FPuzzleAsyncSolver, ESPMode::ThreadSafe>
+{
+public:
+	FPuzzleAsyncSolver();
+
+	/**
+	 * Submit a snapshot of a puzzle to solve.
+	 * @param PuzzleDef The puzzle the annotations were generated from
+	 * @param Annotations The annotations to solve with
+	 * @param bCheckUniqueness If true, also check whether the annotations have exactly one solution
+	 * @return The id of the request, passed to progress and solved events
+	 */
+	int32 Submit(const FPuzzleDef& PuzzleDef, const FPuzzleAnnotations& Annotations, bool bCheckUniqueness = false);
+
+	/** Cancel all submitted puzzles, no more events will be called for them */
+	void Cancel();
+
+	/** Return true if a submitted puzzle has not been reported yet */
+	FORCEINLINE bool IsBusy() const { return CompletedRequestId != LatestRequestId.GetValue(); }
+
+	DECLARE_MULTICAST_DELEGATE_TwoParams(FProgressDelegate, int32 /* RequestId */, float /* Progress */);
+
+	/** Called on the game thread as a puzzle is solved, with the fraction of work done so far */
+	FProgressDelegate OnProgressEvent;
+
+	DECLARE_MULTICAST_DELEGATE_OneParam(FSolvedDelegate, const FPuzzleAsyncSolveResult& /* Result */);
+
+	/** Called on the game thread when the latest submitted puzzle has been solved */
+	FSolvedDelegate OnSolvedEvent;
+
+protected:
+	/** A snapshot of a puzzle waiting to be solved */
+	struct FRequest
+	{
+		int32 RequestId;
+		FPuzzleDef PuzzleDef;
+		FPuzzleAnnotations Annotations;
+		bool bCheckUniqueness;
+	};
+
+	/** Guards the pending request, active checker, and worker state */
+	FCriticalSection CriticalSection;
+
+	/** The latest snapshot waiting to be solved, if any */
+	TOptional<FRequest> PendingRequest;
+
+	/** The uniqueness checker of the request being solved, if any */
+	TSharedPtr<FPuzzleUniquenessChecker, ESPMode::ThreadSafe> ActiveChecker;
+
+	/** Is a background task currently solving requests? */
+	bool bIsWorkerRunning;
+
+	/** The id of the latest request, results of any other request are discarded */
+	FThreadSafeCounter LatestRequestId;
+
+	/** The id of the last request that was reported or cancelled, only used on the game thread */
+	int32 CompletedRequestId;
+
+	/** The progress last reported for the request being solved */
+	float LastReportedProgress;
+
+	FORCEINLINE bool IsLatestRequest(int32 RequestId) const { return RequestId == LatestRequestId.GetValue(); }
+
+	/** Solve pending requests until there are none left. Runs on a background task. */
+	void ProcessRequests();
+
+	/** Solve a single request and report the result */
+	void ProcessRequest(const FRequest& Request, FPuzzleUniquenessChecker& Checker);
+
+	/** Report progress for a request on the game thread, if it has changed enough since last reported */
+	void ReportProgress(int32 RequestId, float Progress);
+};
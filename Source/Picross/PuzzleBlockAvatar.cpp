@@ -9,54 +9,145 @@
 #include "UI/PuzzleRowAnnotationInterface.h"
 
 
-APuzzleBlockAvatar::APuzzleBlockAvatar()
+DECLARE_DWORD_COUNTER_STAT(TEXT("Annotation Rows Displayed"), STAT_PicrossAnnotationRowsDisplayed, STATGROUP_Picross);
+
+
+FName APuzzleBlockAvatar::MeshComponentName(TEXT("Mesh"));
+
+APuzzleBlockAvatar::APuzzleBlockAvatar(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer),
+	  bIsAnimating(false),
+	  bIsBlockOccluded(false),
+	  bIsInstanced(false),
+	  bHasAnnotationDisplayObjects(false),
+	  bAreAnnotationsDisplayed(false),
+	  bIsAnnotationVisibilityDisplayed(false),
+	  bAreAnnotationsVisible(false)
 {
+	FMemory::Memzero(AnnotationDisplayObjectsEnd);
+
+	// there can be thousands of blocks, so they only tick while animating
+	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.bStartWithTickEnabled = false;
+
 	Root = CreateDefaultSubobject<USceneComponent>(TEXT("Root"));
+	Root->PrimaryComponentTick.bCanEverTick = false;
+	Root->SetGenerateOverlapEvents(false);
 	RootComponent = Root;
 
-	Mesh = CreateDefaultSubobject<UStaticMeshComponent>(TEXT("Mesh"));
-	Mesh->SetupAttachment(RootComponent);
+	// optional, so that subclasses only used with instanced grids can skip it, see APuzzleInstancedBlockAvatar
+	Mesh = CreateOptionalDefaultSubobject<UStaticMeshComponent>(MeshComponentName);
+	if (Mesh)
+	{
+		Mesh->SetupAttachment(RootComponent);
+		Mesh->PrimaryComponentTick.bCanEverTick = false;
+		Mesh->SetGenerateOverlapEvents(false);
+		Mesh->SetCanEverAffectNavigation(false);
+	}
 }
 
 void APuzzleBlockAvatar::SetBlock(const FPuzzleBlockDef& InBlock)
 {
 	Block = InBlock;
 	UpdateMesh();
+
+	OnDisplayChangedEvent.Broadcast(this);
+}
+
+void APuzzleBlockAvatar::ResetBlock()
+{
+	OnIdentifyAttemptEvent.Clear();
+	OnStateChangedEvent.Clear();
+	OnDisplayChangedEvent.Clear();
+
+	Block = FPuzzleBlockDef();
+
+	// go through the setters so Blueprint hooks can restore a block that was hidden or broken
+	SetIsBlockHidden(false, false);
+	SetState(EPuzzleBlockState::Unidentified);
+	SetMarkedType(FGameplayTag::EmptyTag);
+	SetIsBlockOccluded(false);
+	SetIsAnimating(false);
+	SetAnnotations(FPuzzleBlockAnnotations());
+	UpdateMesh();
+
+	OnBlockReset_BP();
 }
 
 void APuzzleBlockAvatar::SetAnnotations(const FPuzzleBlockAnnotations& InAnnotations)
 {
+	if (bAreAnnotationsDisplayed && InAnnotations == Annotations)
+	{
+		return;
+	}
+
+	// only send rows that changed, every row if nothing has been sent yet
+	uint8 ChangedAxes = 0;
+	for (int32 Axis = 0; Axis <= 2; ++Axis)
+	{
+		if (!bAreAnnotationsDisplayed || InAnnotations.GetAxisAnnotations(Axis) != Annotations.GetAxisAnnotations(Axis))
+		{
+			ChangedAxes |= 1 << Axis;
+		}
+	}
+
 	Annotations = InAnnotations;
 
-	OnAnnotationsChanged();
+	OnAnnotationsChanged(ChangedAxes);
 }
 
 void APuzzleBlockAvatar::SetAnnotationsVisible_Implementation(bool bNewVisible)
 {
-	TArray<UObject*> XAnnotationObjects = GetAnnotationDisplayObjects(0);
-	for (UObject* Object : XAnnotationObjects)
+	if (bIsAnnotationVisibilityDisplayed && bAreAnnotationsVisible == bNewVisible)
 	{
-		if (Object->Implements<UPuzzleRowAnnotationInterface>())
-		{
-			IPuzzleRowAnnotationInterface::Execute_SetAnnotationsVisible(Object, bNewVisible);
-		}
+		return;
 	}
-	TArray<UObject*> YAnnotationObjects = GetAnnotationDisplayObjects(1);
-	for (UObject* Object : YAnnotationObjects)
+
+	bAreAnnotationsVisible = bNewVisible;
+	bIsAnnotationVisibilityDisplayed = true;
+
+	CacheAnnotationDisplayObjects();
+	for (UObject* Object : AnnotationDisplayObjects)
 	{
-		if (Object->Implements<UPuzzleRowAnnotationInterface>())
-		{
-			IPuzzleRowAnnotationInterface::Execute_SetAnnotationsVisible(Object, bNewVisible);
-		}
+		IPuzzleRowAnnotationInterface::Execute_SetAnnotationsVisible(Object, bNewVisible);
+	}
+}
+
+void APuzzleBlockAvatar::UpdateAnnotations(const FPuzzleBlockAnnotations& InAnnotations, bool bNewVisible)
+{
+	SetAnnotations(InAnnotations);
+	SetAnnotationsVisible(bNewVisible);
+}
+
+void APuzzleBlockAvatar::InvalidateAnnotationDisplayObjects()
+{
+	AnnotationDisplayObjects.Reset();
+	bHasAnnotationDisplayObjects = false;
+	bAreAnnotationsDisplayed = false;
+	bIsAnnotationVisibilityDisplayed = false;
+}
+
+void APuzzleBlockAvatar::CacheAnnotationDisplayObjects()
+{
+	if (bHasAnnotationDisplayObjects)
+	{
+		return;
 	}
-	TArray<UObject*> ZAnnotationObjects = GetAnnotationDisplayObjects(2);
-	for (UObject* Object : ZAnnotationObjects)
+
+	AnnotationDisplayObjects.Reset();
+	for (int32 Axis = 0; Axis <= 2; ++Axis)
 	{
-		if (Object->Implements<UPuzzleRowAnnotationInterface>())
+		for (UObject* Object : GetAnnotationDisplayObjects(Axis))
 		{
-			IPuzzleRowAnnotationInterface::Execute_SetAnnotationsVisible(Object, bNewVisible);
+			if (Object && Object->Implements<UPuzzleRowAnnotationInterface>())
+			{
+				AnnotationDisplayObjects.Add(Object);
+			}
 		}
+		AnnotationDisplayObjectsEnd[Axis] = AnnotationDisplayObjects.Num();
 	}
+
+	bHasAnnotationDisplayObjects = true;
 }
 
 void APuzzleBlockAvatar::SetState(EPuzzleBlockState NewState)
@@ -84,6 +175,7 @@ void APuzzleBlockAvatar::SetState(EPuzzleBlockState NewState)
 		OnStateChanged_BP(NewState, OldState);
 		OnStateChangedEvent.Broadcast(NewState, OldState);
 		OnStateChangedEvent_BP.Broadcast(NewState, OldState);
+		OnDisplayChangedEvent.Broadcast(this);
 	}
 }
 
@@ -108,6 +200,33 @@ void APuzzleBlockAvatar::SetIsBlockHidden(bool bNewHidden, bool bAnimate)
 		{
 			OnBlockShown_BP(bAnimate);
 		}
+
+		OnDisplayChangedEvent.Broadcast(this);
+	}
+}
+
+void APuzzleBlockAvatar::SetIsAnimating(bool bNewAnimating)
+{
+	if (bIsAnimating != bNewAnimating)
+	{
+		bIsAnimating = bNewAnimating;
+		SetActorTickEnabled(bIsAnimating);
+	}
+}
+
+void APuzzleBlockAvatar::SetIsBlockOccluded(bool bNewOccluded)
+{
+	if (bIsBlockOccluded != bNewOccluded)
+	{
+		bIsBlockOccluded = bNewOccluded;
+
+		// actor visibility belongs to Blueprint hide and show animations, occlusion only hides the mesh
+		if (Mesh)
+		{
+			Mesh->SetVisibility(!bIsBlockOccluded);
+		}
+
+		OnDisplayChangedEvent.Broadcast(this);
 	}
 }
 
@@ -136,54 +255,79 @@ void APuzzleBlockAvatar::SetMarkedType(FGameplayTag NewMarkedType)
 	{
 		OnMarkedTypeChanged_BP(MarkedType, OldMarkedType);
 		OnMarkedTypeChangedEvent_BP.Broadcast(MarkedType, OldMarkedType);
+		OnDisplayChangedEvent.Broadcast(this);
 	}
 }
 
+UStaticMesh* APuzzleBlockAvatar::GetDisplayMesh() const
+{
+	if (!BlockMeshSet)
+	{
+		return nullptr;
+	}
+
+	const FGameplayTag StateType = (IsEmptySpace() || !IsIdentified())
+		                               ? GetDefault<UPicrossGameSettings>()->BlockUnidentifiedTag
+		                               : Block.Type;
+	return BlockMeshSet->Meshes.FindRef(StateType);
+}
+
 void APuzzleBlockAvatar::UpdateMesh()
 {
 	if (BlockMeshSet)
 	{
-		const FGameplayTag StateType = (IsEmptySpace() || !IsIdentified())
-			                               ? GetDefault<UPicrossGameSettings>()->BlockUnidentifiedTag
-			                               : Block.Type;
-		UStaticMesh* BlockMesh = BlockMeshSet->Meshes.FindRef(StateType);
-		Mesh->SetStaticMesh(BlockMesh);
+		if (Mesh)
+		{
+			// instanced blocks are drawn by the grid
+			Mesh->SetStaticMesh(bIsInstanced ? nullptr : GetDisplayMesh());
+		}
 
 		OnMeshUpdated();
 	}
 }
 
+void APuzzleBlockAvatar::SetIsInstanced(bool bNewInstanced)
+{
+	if (bIsInstanced != bNewInstanced)
+	{
+		bIsInstanced = bNewInstanced;
+		UpdateMesh();
+	}
+}
+
 void APuzzleBlockAvatar::OnMeshUpdated_Implementation()
 {
 }
 
-void APuzzleBlockAvatar::OnAnnotationsChanged()
+void APuzzleBlockAvatar::OnAnnotationsChanged(uint8 ChangedAxes)
 {
-	TArray<UObject*> XAnnotationObjects = GetAnnotationDisplayObjects(0);
-	for (UObject* Object : XAnnotationObjects)
-	{
-		SetDisplayedAnnotation(Object, Annotations.XAnnotations);
-	}
-	TArray<UObject*> YAnnotationObjects = GetAnnotationDisplayObjects(1);
-	for (UObject* Object : YAnnotationObjects)
-	{
-		SetDisplayedAnnotation(Object, Annotations.YAnnotations);
-	}
-	TArray<UObject*> ZAnnotationObjects = GetAnnotationDisplayObjects(2);
-	for (UObject* Object : ZAnnotationObjects)
+	CacheAnnotationDisplayObjects();
+
+	int32 ObjectIdx = 0;
+	for (int32 Axis = 0; Axis <= 2; ++Axis)
 	{
-		SetDisplayedAnnotation(Object, Annotations.ZAnnotations);
+		const int32 EndIdx = AnnotationDisplayObjectsEnd[Axis];
+		if (ChangedAxes & (1 << Axis))
+		{
+			const FPuzzleRowAnnotations& AxisAnnotations = Annotations.GetAxisAnnotations(Axis);
+			INC_DWORD_STAT(STAT_PicrossAnnotationRowsDisplayed);
+			for (; ObjectIdx < EndIdx; ++ObjectIdx)
+			{
+				SetDisplayedAnnotation(AnnotationDisplayObjects[ObjectIdx], AxisAnnotations);
+			}
+		}
+		ObjectIdx = EndIdx;
 	}
 
+	bAreAnnotationsDisplayed = true;
+
 	OnAnnotationsChanged_BP();
 }
 
 void APuzzleBlockAvatar::SetDisplayedAnnotation(UObject* DisplayObject, const FPuzzleRowAnnotations& Annotation) const
 {
-	if (DisplayObject->Implements<UPuzzleRowAnnotationInterface>())
-	{
-		IPuzzleRowAnnotationInterface::Execute_SetPuzzleRowAnnotations(DisplayObject, Annotation);
-	}
+	// display objects are only cached if they implement the interface
+	IPuzzleRowAnnotationInterface::Execute_SetPuzzleRowAnnotations(DisplayObject, Annotation);
 }
 
 TArray<UObject*> APuzzleBlockAvatar::GetAnnotationDisplayObjects_Implementation(int32 Axis) const
@@ -10,6 +10,7 @@
 
 #include "PuzzleBlockAvatar.generated.h"
 
+class UStaticMesh;
 class UStaticMeshComponent;
 
 
@@ -30,7 +31,10 @@ class PICROSS_API APuzzleBlockAvatar : public AActor
 	UStaticMeshComponent* Mesh;
 
 public:
-	APuzzleBlockAvatar();
+	APuzzleBlockAvatar(const FObjectInitializer& ObjectInitializer = FObjectInitializer::Get());
+
+	/** The name of the mesh component, for subclasses that don't create it */
+	static FName MeshComponentName;
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	FPuzzleBlockDef Block;
@@ -38,7 +42,19 @@ public:
 	UFUNCTION(BlueprintCallable)
 	void SetBlock(const FPuzzleBlockDef& InBlock);
 
-	/** Set the annotations to display */
+	/**
+	 * Reset the block to its default state so that it can be reused for another cell or puzzle.
+	 * Clears all native event bindings, then the block, state, marked type, hidden state, and annotations.
+	 * State, marked type, and hidden state are reset through their setters, so their Blueprint events are called.
+	 */
+	UFUNCTION(BlueprintCallable)
+	void ResetBlock();
+
+	/** Called when the block has been reset to be reused */
+	UFUNCTION(BlueprintImplementableEvent, meta = (DisplayName = "OnBlockReset"))
+	void OnBlockReset_BP();
+
+	/** Set the annotations to display. Only rows whose annotations changed are sent to display objects. */
 	UFUNCTION(BlueprintCallable)
 	void SetAnnotations(const FPuzzleBlockAnnotations& InAnnotations);
 
@@ -46,6 +62,17 @@ public:
 	UFUNCTION(BlueprintNativeEvent)
     void SetAnnotationsVisible(bool bNewVisible);
 
+	/** Set the annotations to display and whether they are visible, in a single update */
+	UFUNCTION(BlueprintCallable)
+	void UpdateAnnotations(const FPuzzleBlockAnnotations& InAnnotations, bool bNewVisible);
+
+	/**
+	 * Clear the cached annotation display objects, so that GetAnnotationDisplayObjects is called again
+	 * and the current annotations are sent to them. Call this when the display objects have changed.
+	 */
+	UFUNCTION(BlueprintCallable)
+	void InvalidateAnnotationDisplayObjects();
+
 	UPROPERTY(EditDefaultsOnly, BlueprintReadWrite)
 	UPuzzleBlockMeshSet* BlockMeshSet;
 
@@ -84,6 +111,27 @@ public:
 	UFUNCTION(BlueprintCallable)
 	void SetIsBlockHidden(bool bNewHidden, bool bAnimate = true);
 
+	/** Is the block currently playing a Blueprint animation, and ticking? */
+	UPROPERTY(Transient, BlueprintReadOnly)
+	bool bIsAnimating;
+
+	/**
+	 * Set whether the block is playing a Blueprint animation. Blocks don't tick unless animating,
+	 * so effects started from OnBlockShown or OnBlockHidden that rely on Tick should enable this while playing.
+	 */
+	UFUNCTION(BlueprintCallable)
+	void SetIsAnimating(bool bNewAnimating);
+
+	/** Is the block completely surrounded by other visible blocks, and not drawn? */
+	UPROPERTY(Transient, BlueprintReadOnly)
+	bool bIsBlockOccluded;
+
+	/**
+	 * Set whether the block is completely surrounded by other visible blocks, hiding its mesh while it is.
+	 * Independent of actor visibility, which is controlled by OnBlockHidden and OnBlockShown.
+	 */
+	void SetIsBlockOccluded(bool bNewOccluded);
+
 	/** Return true if the block is Identified or in its TrueForm */
 	UFUNCTION(BlueprintPure)
 	bool IsIdentified() const;
@@ -99,10 +147,22 @@ public:
 	UFUNCTION(BlueprintPure)
 	bool IsBlockVisible() const;
 
+	/** Return the mesh that should be displayed for the current state */
+	UFUNCTION(BlueprintPure)
+	UStaticMesh* GetDisplayMesh() const;
+
 	/** Update the mesh to display for the current state */
 	UFUNCTION(BlueprintCallable)
 	void UpdateMesh();
 
+	/** Is this block drawn by its grid as a mesh instance, instead of by its own mesh component? */
+	UPROPERTY(Transient, BlueprintReadOnly)
+	bool bIsInstanced;
+
+	/** Set whether this block is drawn by its grid as a mesh instance, instead of by its own mesh component */
+	UFUNCTION(BlueprintCallable)
+	void SetIsInstanced(bool bNewInstanced);
+
 	/** Called when the mesh displayed for this block has been updated */
 	UFUNCTION(BlueprintNativeEvent)
 	void OnMeshUpdated();
@@ -111,8 +171,11 @@ public:
 	UFUNCTION(BlueprintNativeEvent)
 	void OnIncorrectIdentify(FGameplayTag GuessedType);
 
-	/** Called when the annotations for this block have changed */
-	void OnAnnotationsChanged();
+	/**
+	 * Called when the annotations for this block have changed
+	 * @param ChangedAxes Bit mask of the axes whose row annotations have changed
+	 */
+	void OnAnnotationsChanged(uint8 ChangedAxes = 0x7);
 
 	/** Called when the annotations for this block have changed */
 	UFUNCTION(BlueprintImplementableEvent, meta = (DisplayName = "OnAnnotationsChanged"))
@@ -142,6 +205,11 @@ public:
 	/** Called when the state of this block has changed */
 	FStateChangedDelegate OnStateChangedEvent;
 
+	DECLARE_MULTICAST_DELEGATE_OneParam(FDisplayChangedDelegate, APuzzleBlockAvatar* /* BlockAvatar */);
+
+	/** Called when the block, state, marked type, or hidden state has changed, anything affecting how it is drawn */
+	FDisplayChangedDelegate OnDisplayChangedEvent;
+
 	DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FStateChangedDynDelegate, EPuzzleBlockState, NewState,
 	                                             EPuzzleBlockState, OldState);
 
@@ -160,6 +228,28 @@ public:
 	FMarkedTypeChangedDynDelegate OnMarkedTypeChangedEvent_BP;
 
 protected:
+	/** Display objects that implement IPuzzleRowAnnotationInterface, cached from GetAnnotationDisplayObjects */
+	UPROPERTY(Transient)
+	TArray<UObject*> AnnotationDisplayObjects;
+
+	/** The index after the last display object for each axis in AnnotationDisplayObjects */
+	int32 AnnotationDisplayObjectsEnd[3];
+
+	/** Have the annotation display objects been cached? */
+	bool bHasAnnotationDisplayObjects;
+
+	/** Have the current annotations been sent to the display objects? */
+	bool bAreAnnotationsDisplayed;
+
+	/** Has the current annotation visibility been sent to the display objects? */
+	bool bIsAnnotationVisibilityDisplayed;
+
+	/** The annotation visibility last sent to the display objects */
+	bool bAreAnnotationsVisible;
+
+	/** Cache the annotation display objects if they haven't been already */
+	void CacheAnnotationDisplayObjects();
+
 	void SetDisplayedAnnotation(UObject* DisplayObject, const FPuzzleRowAnnotations& Annotation) const;
 
 public:
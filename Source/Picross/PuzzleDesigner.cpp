@@ -4,12 +4,16 @@
 #include "PuzzleDesigner.h"
 
 
+#include "PuzzleAsyncSolver.h"
 #include "PuzzleBlockAvatar.h"
 #include "PuzzleGrid.h"
 
 
 APuzzleDesigner::APuzzleDesigner()
-	: DefaultDimensions(3, 3, 3)
+	: DefaultDimensions(3, 3, 3),
+	  bCheckUniqueness(true),
+	  Uniqueness(EPuzzleUniqueness::Unknown),
+	  UniquenessCheckProgress(0.f)
 {
 	PuzzleGridClass = APuzzleGrid::StaticClass();
 }
@@ -30,6 +34,10 @@ void APuzzleDesigner::SetDimensions(FIntVector NewDimensions, bool bCommit)
 	{
 		CommitDimensions();
 	}
+	else
+	{
+		OnPuzzleEdited();
+	}
 }
 
 void APuzzleDesigner::SetBlockType(FIntVector Position, FGameplayTag NewBlockType)
@@ -39,21 +47,9 @@ void APuzzleDesigner::SetBlockType(FIntVector Position, FGameplayTag NewBlockTyp
 		return;
 	}
 
-	FPuzzleDef NewPuzzleDef = PuzzleGrid->PuzzleDef;
-	const int32 Idx = NewPuzzleDef.GetBlockIndexAtPosition(Position);
-	if (Idx == INDEX_NONE)
-	{
-		FPuzzleBlockDef NewBlockDef;
-		NewBlockDef.Position = Position;
-		NewBlockDef.Type = NewBlockType;
-		NewPuzzleDef.Blocks.Add(NewBlockDef);
-	}
-	else
-	{
-		NewPuzzleDef.Blocks[Idx].Type = NewBlockType;
-	}
+	PuzzleGrid->SetBlockType(Position, NewBlockType);
 
-	PuzzleGrid->SetPuzzle(NewPuzzleDef, true);
+	OnPuzzleEdited();
 }
 
 void APuzzleDesigner::CommitDimensions()
@@ -70,7 +66,81 @@ void APuzzleDesigner::CommitDimensions()
 		}
 	}
 
+	PuzzleGrid->PuzzleDef.UpdateBlockGrid();
+
 	PuzzleGrid->RegenerateBlockAvatars();
+
+	OnPuzzleEdited();
+}
+
+void APuzzleDesigner::CheckUniqueness()
+{
+	if (!PuzzleGrid)
+	{
+		CancelUniquenessCheck();
+		return;
+	}
+
+	if (!AsyncSolver.IsValid())
+	{
+		AsyncSolver = MakeShared<FPuzzleAsyncSolver, ESPMode::ThreadSafe>();
+		AsyncSolver->OnProgressEvent.AddUObject(this, &APuzzleDesigner::OnUniquenessCheckProgress);
+		AsyncSolver->OnSolvedEvent.AddUObject(this, &APuzzleDesigner::OnUniquenessChecked);
+	}
+
+	FPuzzleAnnotations Annotations;
+	FPuzzleAnnotations::GenerateAnnotations(PuzzleGrid->PuzzleDef, Annotations);
+
+	// replaces any check that is still running
+	AsyncSolver->Submit(PuzzleGrid->PuzzleDef, Annotations, true);
+
+	Uniqueness = EPuzzleUniqueness::Unknown;
+	AmbiguousCells.Reset();
+	UniquenessCheckProgress = 0.f;
+}
+
+void APuzzleDesigner::CancelUniquenessCheck()
+{
+	if (AsyncSolver.IsValid())
+	{
+		AsyncSolver->Cancel();
+	}
+}
+
+bool APuzzleDesigner::IsCheckingUniqueness() const
+{
+	return AsyncSolver.IsValid() && AsyncSolver->IsBusy();
+}
+
+void APuzzleDesigner::OnUniquenessCheckProgress(int32 RequestId, float Progress)
+{
+	UniquenessCheckProgress = Progress;
+}
+
+void APuzzleDesigner::OnUniquenessChecked(const FPuzzleAsyncSolveResult& Result)
+{
+	Uniqueness = Result.Uniqueness;
+	AmbiguousCells = Result.AmbiguousCells;
+	UniquenessCheckProgress = 1.f;
+
+	OnUniquenessCheckedEvent.Broadcast(Uniqueness);
+	OnUniquenessCheckedEvent_BP.Broadcast(Uniqueness);
+}
+
+void APuzzleDesigner::OnPuzzleEdited()
+{
+	if (bCheckUniqueness)
+	{
+		CheckUniqueness();
+	}
+	else
+	{
+		// any result, or check still running, was for the puzzle before this edit
+		CancelUniquenessCheck();
+		Uniqueness = EPuzzleUniqueness::Unknown;
+		AmbiguousCells.Reset();
+		UniquenessCheckProgress = 0.f;
+	}
 }
 
 void APuzzleDesigner::BeginPlay()
@@ -84,9 +154,17 @@ void APuzzleDesigner::BeginPlay()
 
 	if (PuzzleGrid)
 	{
+		OnPuzzleEdited();
 	}
 }
 
+void APuzzleDesigner::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	CancelUniquenessCheck();
+
+	Super::EndPlay(EndPlayReason);
+}
+
 void APuzzleDesigner::OnBlockIdentifyAttempt(APuzzleBlockAvatar* BlockAvatar, FGameplayTag BlockType)
 {
 	SetBlockType(BlockAvatar->Block.Position, BlockType);
@@ -6,12 +6,15 @@
 
 
 #include "GameplayTagContainer.h"
+#include "PuzzleTypes.h"
 #include "GameFramework/Actor.h"
 
 #include "PuzzleDesigner.generated.h"
 
 class APuzzleBlockAvatar;
 class APuzzleGrid;
+class FPuzzleAsyncSolver;
+struct FPuzzleAsyncSolveResult;
 
 
 /**
@@ -44,13 +47,65 @@ public:
 
 	FORCEINLINE APuzzleGrid* GetPuzzleGrid() const { return PuzzleGrid; }
 
+	/** If true, check whether the puzzle has exactly one solution in the background after each edit */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	bool bCheckUniqueness;
+
+	/** The result of the last uniqueness check, unknown while a check is running or after an unchecked edit */
+	UPROPERTY(Transient, BlueprintReadOnly)
+	EPuzzleUniqueness Uniqueness;
+
+	/** Cells that differ between two solutions of the puzzle, if the last check found it to be ambiguous */
+	UPROPERTY(Transient, BlueprintReadOnly)
+	TArray<FIntVector> AmbiguousCells;
+
+	/** The fraction of the running uniqueness check that is done */
+	UPROPERTY(Transient, BlueprintReadOnly)
+	float UniquenessCheckProgress;
+
+	/** Start checking whether the puzzle has exactly one solution, cancelling any check already running */
+	UFUNCTION(BlueprintCallable)
+	void CheckUniqueness();
+
+	/** Cancel the uniqueness check that is running, if any */
+	UFUNCTION(BlueprintCallable)
+	void CancelUniquenessCheck();
+
+	/** Return true if a uniqueness check is running */
+	UFUNCTION(BlueprintPure)
+	bool IsCheckingUniqueness() const;
+
+	DECLARE_MULTICAST_DELEGATE_OneParam(FUniquenessCheckedDelegate, EPuzzleUniqueness /* Uniqueness */);
+
+	/** Called when a uniqueness check has finished */
+	FUniquenessCheckedDelegate OnUniquenessCheckedEvent;
+
+	DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FUniquenessCheckedDynDelegate, EPuzzleUniqueness, Uniqueness);
+
+	/** Called when a uniqueness check has finished */
+	UPROPERTY(BlueprintAssignable)
+	FUniquenessCheckedDynDelegate OnUniquenessCheckedEvent_BP;
+
 protected:
 	UPROPERTY(Transient, BlueprintReadOnly, meta = (AllowPrivateAccess = "true"))
 	APuzzleGrid* PuzzleGrid;
 
+	/** Solves snapshots of the puzzle in the background to check uniqueness */
+	TSharedPtr<FPuzzleAsyncSolver, ESPMode::ThreadSafe> AsyncSolver;
+
 	APuzzleGrid* CreatePuzzleGrid();
 
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	/** Called when the running uniqueness check has made progress */
+	void OnUniquenessCheckProgress(int32 RequestId, float Progress);
+
+	/** Called when a uniqueness check has finished */
+	void OnUniquenessChecked(const FPuzzleAsyncSolveResult& Result);
+
+	/** Check uniqueness after an edit if enabled, otherwise cancel any check and forget the last result */
+	void OnPuzzleEdited();
 
 	void OnBlockIdentifyAttempt(APuzzleBlockAvatar* BlockAvatar, FGameplayTag BlockType);
 };
@@ -0,0 +1,210 @@
+﻿// Copyright Bohdon Sayre.
+
+
+#include "PuzzleGenerator.h"
+
+#include "Picross.h"
+#include "PuzzleSolver.h"
+#include "Async/ParallelFor.h"
+
+
+DECLARE_CYCLE_STAT(TEXT("Generate Puzzle"), STAT_PicrossGeneratePuzzle, STATGROUP_Picross);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Generated Puzzle Repairs"), STAT_PicrossGeneratedPuzzleRepairs, STATGROUP_Picross);
+
+
+/** Each repair changes this fraction of the undeduced cells, at least one */
+static constexpr int32 PuzzleGeneratorRepairDivisor = 4;
+
+
+FPuzzleGenerator::FPuzzleGenerator()
+	: Dimensions(10, 10, 10),
+	  Density(0.5f),
+	  MaxAttempts(8),
+	  MaxRepairs(200)
+{
+}
+
+bool FPuzzleGenerator::AreSettingsValid() const
+{
+	if (Dimensions.GetMin() <= 0 || Dimensions.GetMax() > FPuzzleSolver::MaxRowLength)
+	{
+		UE_LOG(LogPicross, Warning, TEXT("Cannot generate puzzles with dimensions %s"), *Dimensions.ToString());
+		return false;
+	}
+
+	if (BlockTypes.Num() == 0 || BlockTypes.Num() > FPuzzleSolver::MaxBlockTypes)
+	{
+		UE_LOG(LogPicross, Warning, TEXT("Cannot generate puzzles with %d block types"), BlockTypes.Num());
+		return false;
+	}
+
+	for (const FGameplayTag& BlockType : BlockTypes)
+	{
+		if (!BlockType.IsValid())
+		{
+			UE_LOG(LogPicross, Warning, TEXT("Cannot generate puzzles with an invalid block type"));
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool FPuzzleGenerator::Generate(int32 Seed, FPuzzleDef& OutPuzzleDef) const
+{
+	SCOPE_CYCLE_COUNTER(STAT_PicrossGeneratePuzzle);
+
+	if (!AreSettingsValid())
+	{
+		return false;
+	}
+
+	FRandomStream RandomStream(Seed);
+	FPuzzleSolver Solver;
+	Solver.SetRecordSteps(false);
+
+	for (int32 Attempt = 0; Attempt < MaxAttempts; ++Attempt)
+	{
+		if (TryGenerate(RandomStream, Solver, OutPuzzleDef))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void FPuzzleGenerator::GenerateMany(int32 Seed, int32 NumPuzzles, TArray<FPuzzleDef>& OutPuzzleDefs) const
+{
+	OutPuzzleDefs.Reset();
+
+	if (NumPuzzles <= 0 || !AreSettingsValid())
+	{
+		return;
+	}
+
+	TArray<FPuzzleDef> PuzzleDefs;
+	PuzzleDefs.SetNum(NumPuzzles);
+	TArray<bool> Succeeded;
+	Succeeded.Init(false, NumPuzzles);
+
+	ParallelFor(NumPuzzles, [this, Seed, &PuzzleDefs, &Succeeded](int32 Idx)
+	{
+		const int32 PuzzleSeed = static_cast<int32>(HashCombine(GetTypeHash(Seed), GetTypeHash(Idx)));
+		Succeeded[Idx] = Generate(PuzzleSeed, PuzzleDefs[Idx]);
+	});
+
+	OutPuzzleDefs.Reserve(NumPuzzles);
+	for (int32 Idx = 0; Idx < NumPuzzles; ++Idx)
+	{
+		if (Succeeded[Idx])
+		{
+			OutPuzzleDefs.Add(MoveTemp(PuzzleDefs[Idx]));
+		}
+	}
+}
+
+bool FPuzzleGenerator::TryGenerate(FRandomStream& RandomStream, FPuzzleSolver& Solver, FPuzzleDef& PuzzleDef) const
+{
+	PuzzleDef = FPuzzleDef();
+	PuzzleDef.Dimensions = Dimensions;
+	PuzzleDef.AnnotationSeed = RandomStream.RandHelper(MAX_int32);
+
+	int32 NumFilled = 0;
+	for (int32 X = 0; X < Dimensions.X; ++X)
+	{
+		for (int32 Y = 0; Y < Dimensions.Y; ++Y)
+		{
+			for (int32 Z = 0; Z < Dimensions.Z; ++Z)
+			{
+				if (RandomStream.FRand() < Density)
+				{
+					FPuzzleBlockDef& BlockDef = PuzzleDef.Blocks.AddDefaulted_GetRef();
+					BlockDef.Position = FIntVector(X, Y, Z);
+					BlockDef.Type = BlockTypes[RandomStream.RandHelper(BlockTypes.Num())];
+					++NumFilled;
+				}
+			}
+		}
+	}
+	PuzzleDef.UpdateBlockGrid();
+
+	FPuzzleAnnotations Annotations;
+	FPuzzleAnnotations::GenerateAnnotations(PuzzleDef, Annotations);
+
+	const int32 TargetNumFilled = FMath::RoundToInt(Density * PuzzleDef.GetNumCells());
+	TArray<int32> FilledCellIndices;
+	TArray<int32> EmptyCellIndices;
+	for (int32 Repair = 0;; ++Repair)
+	{
+		if (!Solver.Initialize(Annotations))
+		{
+			return false;
+		}
+
+		if (Solver.SolvePuzzle())
+		{
+			INC_DWORD_STAT_BY(STAT_PicrossGeneratedPuzzleRepairs, Repair);
+			return true;
+		}
+
+		if (Repair >= MaxRepairs || Solver.GetResult().State == EPuzzleSolverState::Contradiction)
+		{
+			INC_DWORD_STAT_BY(STAT_PicrossGeneratedPuzzleRepairs, Repair);
+			return false;
+		}
+
+		// change cells that couldn't be deduced, removing or adding blocks to keep the density near the target
+		FilledCellIndices.Reset();
+		EmptyCellIndices.Reset();
+		for (int32 CellIdx = 0; CellIdx < PuzzleDef.GetNumCells(); ++CellIdx)
+		{
+			if (!Solver.IsCellKnown(CellIdx))
+			{
+				(PuzzleDef.GetBlockTypeIndexAtCell(CellIdx) != 0 ? FilledCellIndices : EmptyCellIndices).Add(CellIdx);
+			}
+		}
+
+		// change more cells at once while many are undeduced, to need fewer solves
+		const int32 NumToRepair = FMath::Max(1, Solver.GetNumUnknownCells() / PuzzleGeneratorRepairDivisor);
+		for (int32 Idx = 0; Idx < NumToRepair; ++Idx)
+		{
+			const bool bRemoveBlock = FilledCellIndices.Num() > 0 &&
+				(NumFilled > TargetNumFilled || EmptyCellIndices.Num() == 0);
+			TArray<int32>& CellIndices = bRemoveBlock ? FilledCellIndices : EmptyCellIndices;
+			if (CellIndices.Num() == 0)
+			{
+				break;
+			}
+
+			const int32 PickIdx = RandomStream.RandHelper(CellIndices.Num());
+			const int32 CellIdx = CellIndices[PickIdx];
+			CellIndices.RemoveAtSwap(PickIdx);
+
+			const FIntVector Position = PuzzleDef.GetCellPosition(CellIdx);
+			if (bRemoveBlock)
+			{
+				PuzzleDef.SetBlockType(Position, FGameplayTag());
+				--NumFilled;
+			}
+			else
+			{
+				PuzzleDef.SetBlockType(Position, BlockTypes[RandomStream.RandHelper(BlockTypes.Num())]);
+				++NumFilled;
+			}
+
+			UpdateCrossingAnnotations(PuzzleDef, Position, Annotations);
+		}
+	}
+}
+
+void FPuzzleGenerator::UpdateCrossingAnnotations(const FPuzzleDef& PuzzleDef, const FIntVector& Position,
+                                                 FPuzzleAnnotations& Annotations)
+{
+	for (int32 Axis = 0; Axis <= 2; ++Axis)
+	{
+		const FPuzzleRow Row(Position, Axis);
+		const int32 AxisRowIndex = Row.GetAxisRowIndex(PuzzleDef.Dimensions);
+		Annotations.GetAxisRowAnnotations(Axis)[AxisRowIndex] = FPuzzleAnnotations::GenerateRowAnnotation(PuzzleDef, Row);
+	}
+}
@@ -0,0 +1,64 @@
+﻿// Copyright Bohdon Sayre.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "GameplayTagContainer.h"
+#include "PuzzleTypes.h"
+
+class FPuzzleSolver;
+
+
+/**
+ * Generates random puzzles that can be fully solved by deduction from their annotations,
+ * which also guarantees that each puzzle has exactly one solution.
+ *
+ * Cells are filled randomly to the target density, then the puzzle is solved with the annotations
+ * it generates. While the solver gets stuck, some of the cells it could not deduce are changed, keeping
+ * the density near the target, and only the rows crossing those cells are regenerated before solving again.
+ * Puzzles that still can't be solved after a number of repairs are discarded and generated again.
+ */
+class PICROSS_API FPuzzleGenerator
+{
+public:
+	FPuzzleGenerator();
+
+	/** The dimensions of puzzles to generate */
+	FIntVector Dimensions;
+
+	/** The block types to fill cells with, chosen randomly for each block */
+	TArray<FGameplayTag> BlockTypes;
+
+	/** The fraction of cells to fill with blocks */
+	float Density;
+
+	/** The maximum number of times a puzzle is generated from scratch before giving up */
+	int32 MaxAttempts;
+
+	/** The maximum number of times to change cells in each attempt to make a puzzle solvable */
+	int32 MaxRepairs;
+
+	/** Return true if the settings can be used to generate puzzles, logging any problems */
+	bool AreSettingsValid() const;
+
+	/**
+	 * Generate a single puzzle. The same seed always generates the same puzzle.
+	 * @return False if no solvable puzzle could be generated
+	 */
+	bool Generate(int32 Seed, FPuzzleDef& OutPuzzleDef) const;
+
+	/**
+	 * Generate many puzzles in parallel, each from a seed derived from the given seed and its index.
+	 * Puzzles that could not be generated are left out.
+	 */
+	void GenerateMany(int32 Seed, int32 NumPuzzles, TArray<FPuzzleDef>& OutPuzzleDefs) const;
+
+protected:
+	/** Fill a puzzle randomly, then repair it until it can be solved */
+	bool TryGenerate(FRandomStream& RandomStream, FPuzzleSolver& Solver, FPuzzleDef& PuzzleDef) const;
+
+	/** Regenerate the annotations of the rows crossing a cell */
+	static void UpdateCrossingAnnotations(const FPuzzleDef& PuzzleDef, const FIntVector& Position,
+	                                      FPuzzleAnnotations& Annotations);
+};
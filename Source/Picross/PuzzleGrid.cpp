@@ -4,24 +4,61 @@
 #include "PuzzleGrid.h"
 
 
+#include "Picross.h"
 #include "PicrossGameModeBase.h"
 #include "PuzzleBlockAvatar.h"
 #include "PuzzleGridSlicerHandle.h"
+#include "PuzzleInstancedBlockAvatar.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Engine/CollisionProfile.h"
 #include "Kismet/GameplayStatics.h"
 
 
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Pooled Block Avatars"), STAT_PicrossPooledBlockAvatars, STATGROUP_Picross);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Block Avatars Spawned"), STAT_PicrossBlockAvatarsSpawned, STATGROUP_Picross);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Block Avatars Reused"), STAT_PicrossBlockAvatarsReused, STATGROUP_Picross);
+
+
 APuzzleGrid::APuzzleGrid()
 	: bGenerateOnBeginPlay(false),
 	  bGenerateEmptyBlocks(true),
 	  DefaultBlockState(EPuzzleBlockState::Unidentified),
+	  bUseInstancedBlocks(false),
+	  bEnableBlockCollision(true),
+	  bCullOccludedBlocks(true),
+	  BlockInstanceCollisionProfile(UCollisionProfile::BlockAllDynamic_ProfileName),
 	  SlicerPadding(50.f),
 	  SmoothInputSpeed(10.f),
 	  RotateSpeed(45.f),
-	  MaxPitchAngle(85.f)
+	  MaxPitchAngle(85.f),
+	  bSleepWhenIdle(true),
+	  bTimeSliceGeneration(false),
+	  GenerationBudgetMs(4.f),
+	  bPoolBlockAvatars(true),
+	  AppliedSlicerAxis(0),
+	  AppliedSlicerPosition(0),
+	  AppliedSlicerDimensions(FIntVector::ZeroValue),
+	  RotateRightInput(0.f),
+	  RotateUpInput(0.f),
+	  SmoothRotateRightInput(0.f),
+	  SmoothRotateUpInput(0.f),
+	  RotateYaw(0.f),
+	  RotatePitch(0.f),
+	  LayoutCameraRotation(FQuat::Identity),
+	  LayoutGridRotation(FQuat::Identity),
+	  bIsLayoutDirty(true),
+	  SlicerLayoutKey(INDEX_NONE),
+	  SlicerLayoutHalfSize(FVector::ZeroVector),
+	  BlockIndexDimensions(FIntVector::ZeroValue),
+	  NumIndexedBlockAvatars(0),
+	  bIsGeneratingBlocks(false),
+	  NextGenerateBlockIndex(0),
+	  NextGenerateCellIndex(0)
 {
 	Root = CreateDefaultSubobject<USceneComponent>(TEXT("Root"));
 
 	BlockAvatarClass = APuzzleBlockAvatar::StaticClass();
+	InstancedBlockAvatarClass = APuzzleInstancedBlockAvatar::StaticClass();
 
 	PrimaryActorTick.bCanEverTick = true;
 }
@@ -29,12 +66,16 @@ APuzzleGrid::APuzzleGrid()
 void APuzzleGrid::SetPuzzle(const FPuzzleDef& InPuzzle, bool bRegenerateBlocks)
 {
 	PuzzleDef = InPuzzle;
+	PuzzleDef.UpdateBlockGrid();
 
 	for (APuzzleGridSlicerHandle* SlicerHandle : SlicerHandles)
 	{
 		SlicerHandle->SetDimension(PuzzleDef.Dimensions[SlicerHandle->Axis]);
 	}
 
+	// slicer handles are positioned around the outside of the grid
+	RequestLayoutUpdate();
+
 	// update slicer position, re-applying clamping
 	SetSlicerPosition(SlicerAxis, SlicerPosition);
 
@@ -42,6 +83,57 @@ void APuzzleGrid::SetPuzzle(const FPuzzleDef& InPuzzle, bool bRegenerateBlocks)
 	{
 		RegenerateBlockAvatars();
 	}
+	else if (BlockIndexDimensions != PuzzleDef.Dimensions)
+	{
+		RebuildBlockIndex();
+	}
+}
+
+void APuzzleGrid::SetBlockType(const FIntVector& Position, FGameplayTag NewBlockType)
+{
+	if (!PuzzleDef.SetBlockType(Position, NewBlockType))
+	{
+		return;
+	}
+
+	if (!PuzzleDef.IsValidPosition(Position))
+	{
+		// avatars outside the puzzle dimensions aren't indexed, so just regenerate everything
+		RegenerateBlockAvatars();
+		OnBlockTypeChangedEvent.Broadcast(Position);
+		return;
+	}
+
+	FPuzzleBlockDef NewBlock = PuzzleDef.GetBlockAtPosition(Position);
+	const bool bIsEmpty = !NewBlock.IsValid();
+	if (bIsEmpty)
+	{
+		NewBlock.Type = EmptyBlockType;
+		NewBlock.Position = Position;
+	}
+
+	APuzzleBlockAvatar* BlockAvatar = GetBlockAtPosition(Position);
+	if (BlockAvatar && bIsEmpty && !bGenerateEmptyBlocks)
+	{
+		// no avatar is needed for the empty space
+		const int32 CellIndex = PuzzleDef.GetCellIndex(Position);
+		ReleaseBlockInstance(CellIndex);
+		BlocksByPosition[CellIndex] = nullptr;
+		--NumIndexedBlockAvatars;
+		BlockAvatars.RemoveSingleSwap(BlockAvatar, false);
+		ReleaseBlockAvatar(BlockAvatar);
+		UpdateBlockExposure(CellIndex);
+	}
+	else if (BlockAvatar)
+	{
+		BlockAvatar->SetBlock(NewBlock);
+	}
+	else if ((!bIsEmpty || bGenerateEmptyBlocks) && BlockIndexDimensions == PuzzleDef.Dimensions)
+	{
+		CreateBlockAvatar(NewBlock);
+	}
+
+	OnBlockTypeChangedEvent.Broadcast(Position);
 }
 
 void APuzzleGrid::OnConstruction(const FTransform& Transform)
@@ -71,13 +163,30 @@ void APuzzleGrid::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
 	Super::EndPlay(EndPlayReason);
 
-	DestroyBlockAvatars();
+	{
+		// avatars are destroyed with the grid, so don't reset each one into the pool first
+		TGuardValue<bool> PoolBlockAvatarsGuard(bPoolBlockAvatars, false);
+		DestroyBlockAvatars();
+	}
+	EmptyBlockAvatarPool();
 }
 
 void APuzzleGrid::Tick(float DeltaSeconds)
 {
 	Super::Tick(DeltaSeconds);
 
+	if (bIsGeneratingBlocks)
+	{
+		if (GenerateBlockAvatarsUntil(FPlatformTime::Seconds() + GenerationBudgetMs * 0.001))
+		{
+			OnBlocksGenerated();
+		}
+		else
+		{
+			OnGenerationProgressEvent.Broadcast(GetGenerationProgress());
+		}
+	}
+
 	// update smooth input
 	SmoothRotateRightInput = FMath::Lerp(SmoothRotateRightInput, RotateRightInput, SmoothInputSpeed * DeltaSeconds);
 	SmoothRotateUpInput = FMath::Lerp(SmoothRotateUpInput, RotateUpInput, SmoothInputSpeed * DeltaSeconds);
@@ -99,56 +208,93 @@ void APuzzleGrid::Tick(float DeltaSeconds)
 	}
 
 	// rotations applied relative to camera
+	const FQuat CameraQuat = FQuat(CameraRotation);
 	const FRotator PitchRot = FRotator(RotatePitch, 0.f, 0.f);
 	const FRotator YawRot = FRotator(0.f, RotateYaw, 0.f);
-	const FRotator NewRotation = (FQuat(CameraRotation) * FQuat(PitchRot) * FQuat(YawRot)).Rotator();
-	SetActorRotation(NewRotation);
+	const FQuat NewRotation = CameraQuat * FQuat(PitchRot) * FQuat(YawRot);
 
-	// TODO(bsayre): cache
-	APlayerController* PC = UGameplayStatics::GetPlayerController(this, 0);
-	if (PC && PC->PlayerCameraManager)
+	if (bIsLayoutDirty || !CameraQuat.Equals(LayoutCameraRotation, KINDA_SMALL_NUMBER * 0.01f) ||
+		!NewRotation.Equals(LayoutGridRotation, KINDA_SMALL_NUMBER * 0.01f))
 	{
-		const FVector CameraVector = PC->PlayerCameraManager->GetCameraRotation().Vector();
+		SetActorRotation(NewRotation);
+		UpdateSlicerHandleLayout(CameraRotation.Vector());
 
-		// get camera dot for each axis of the grid
-		FVector CameraDots;
-		CameraDots.X = -CameraVector | GetActorForwardVector();
-		CameraDots.Y = -CameraVector | GetActorRightVector();
-		CameraDots.Z = -CameraVector | GetActorUpVector();
+		LayoutCameraRotation = CameraQuat;
+		LayoutGridRotation = NewRotation;
+		bIsLayoutDirty = false;
+	}
+	else if (bSleepWhenIdle && !bIsGeneratingBlocks &&
+		FMath::Abs(SmoothRotateRightInput) < KINDA_SMALL_NUMBER &&
+		FMath::Abs(SmoothRotateUpInput) < KINDA_SMALL_NUMBER)
+	{
+		// nothing is moving, tick again when there is new input
+		SmoothRotateRightInput = 0.f;
+		SmoothRotateUpInput = 0.f;
+		SetActorTickEnabled(false);
+	}
+}
 
-		const FVector GridHalfSize = FVector(PuzzleDef.Dimensions) * GetBlockSize() * 0.5f + SlicerPadding;
+void APuzzleGrid::UpdateSlicerHandleLayout(const FVector& CameraVector)
+{
+	// get camera dot for each axis of the grid
+	FVector CameraDots;
+	CameraDots.X = -CameraVector | GetActorForwardVector();
+	CameraDots.Y = -CameraVector | GetActorRightVector();
+	CameraDots.Z = -CameraVector | GetActorUpVector();
 
-		for (APuzzleGridSlicerHandle* SlicerHandle : SlicerHandles)
-		{
-			// update slicer visibility
-			const float SlicerDot = CameraDots[SlicerHandle->Axis];
-			const bool bNewVisible = SlicerHandle->bInvertPosition
-				                         ? SlicerDot > SMALL_NUMBER
-				                         : SlicerDot < -SMALL_NUMBER;
-			SlicerHandle->SetSlicerVisible(bNewVisible);
+	const FVector GridHalfSize = FVector(PuzzleDef.Dimensions) * GetBlockSize() * 0.5f + SlicerPadding;
 
-			// update slicer location (ensure it's on the back side of the grid)
-			FVector Location = GridHalfSize;
-			// flip location along slicer axis depending on which side (front or back)
-			Location[SlicerHandle->Axis] *= SlicerHandle->bInvertPosition ? 1.f : -1.f;
+	// the layout only depends on which side of each axis the camera is on
+	int32 NewLayoutKey = 0;
+	for (int32 Axis = 0; Axis <= 2; ++Axis)
+	{
+		NewLayoutKey |= (CameraDots[Axis] >= 0.f ? 1 : 0) << (Axis * 3);
+		NewLayoutKey |= (CameraDots[Axis] > SMALL_NUMBER ? 1 : 0) << (Axis * 3 + 1);
+		NewLayoutKey |= (CameraDots[Axis] < -SMALL_NUMBER ? 1 : 0) << (Axis * 3 + 2);
+	}
 
-			if (SlicerHandle->Axis < 2)
-			{
-				const int32 OtherAxis = SlicerHandle->Axis == 0 ? 1 : 0;
+	if (NewLayoutKey == SlicerLayoutKey && GridHalfSize.Equals(SlicerLayoutHalfSize))
+	{
+		return;
+	}
 
-				// X and Y slicers are centered vertically
-				Location.Z = 0.f;
-				// X and Y slicers flip the off-axis based on view
-				const float SlicerOtherDot = CameraDots[OtherAxis];
-				Location[OtherAxis] *= SlicerOtherDot >= 0.f ? -1.f : 1.f;
-			}
-			else
-			{
-				// for z, use both X and Y dot, and position it at the back of the grid
-				Location.X *= CameraDots.X >= 0.f ? -1.f : 1.f;
-				Location.Y *= CameraDots.Y >= 0.f ? -1.f : 1.f;
-			}
+	SlicerLayoutKey = NewLayoutKey;
+	SlicerLayoutHalfSize = GridHalfSize;
+
+	for (APuzzleGridSlicerHandle* SlicerHandle : SlicerHandles)
+	{
+		// update slicer visibility
+		const float SlicerDot = CameraDots[SlicerHandle->Axis];
+		const bool bNewVisible = SlicerHandle->bInvertPosition
+			                         ? SlicerDot > SMALL_NUMBER
+			                         : SlicerDot < -SMALL_NUMBER;
+		SlicerHandle->SetSlicerVisible(bNewVisible);
+
+		// update slicer location (ensure it's on the back side of the grid)
+		FVector Location = GridHalfSize;
+		// flip location along slicer axis depending on which side (front or back)
+		Location[SlicerHandle->Axis] *= SlicerHandle->bInvertPosition ? 1.f : -1.f;
+
+		if (SlicerHandle->Axis < 2)
+		{
+			const int32 OtherAxis = SlicerHandle->Axis == 0 ? 1 : 0;
 
+			// X and Y slicers are centered vertically
+			Location.Z = 0.f;
+			// X and Y slicers flip the off-axis based on view
+			const float SlicerOtherDot = CameraDots[OtherAxis];
+			Location[OtherAxis] *= SlicerOtherDot >= 0.f ? -1.f : 1.f;
+		}
+		else
+		{
+			// for z, use both X and Y dot, and position it at the back of the grid
+			Location.X *= CameraDots.X >= 0.f ? -1.f : 1.f;
+			Location.Y *= CameraDots.Y >= 0.f ? -1.f : 1.f;
+		}
+
+		const USceneComponent* HandleRoot = SlicerHandle->GetRootComponent();
+		if (!HandleRoot || !HandleRoot->GetRelativeLocation().Equals(Location))
+		{
 			SlicerHandle->SetActorRelativeLocation(Location);
 		}
 	}
@@ -162,58 +308,119 @@ void APuzzleGrid::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedE
 
 	if (PropertyName == GET_MEMBER_NAME_CHECKED(APuzzleGrid, PuzzleDef))
 	{
+		PuzzleDef.UpdateBlockGrid();
 		RegenerateBlockAvatars();
 	}
 
 	Super::PostEditChangeProperty(PropertyChangedEvent);
 }
 
+APlayerCameraManager* APuzzleGrid::GetPlayerCameraManager() const
+{
+	if (!CachedCameraManager.IsValid())
+	{
+		APlayerController* PC = UGameplayStatics::GetPlayerController(this, 0);
+		CachedCameraManager = PC ? PC->PlayerCameraManager : nullptr;
+	}
+	return CachedCameraManager.Get();
+}
+
 FRotator APuzzleGrid::GetPlayerCameraRotation() const
 {
-	APlayerController* PC = UGameplayStatics::GetPlayerController(this, 0);
-	if (PC && PC->PlayerCameraManager)
+	APlayerCameraManager* CameraManager = GetPlayerCameraManager();
+	if (CameraManager)
 	{
-		return PC->PlayerCameraManager->GetCameraRotation();
+		return CameraManager->GetCameraRotation();
 	}
 	return FRotator();
 }
 
 void APuzzleGrid::GenerateBlockAvatars()
 {
-	if (BlockAvatars.Num() > 0)
+	if (BlockAvatars.Num() > 0 || bIsGeneratingBlocks)
 	{
 		return;
 	}
 
-	BlocksByPosition.Reset();
+	// PuzzleDef may have been edited in place, which the block grid can't detect
+	PuzzleDef.UpdateBlockGrid();
 
+	RebuildBlockIndex();
+
+	NextGenerateBlockIndex = 0;
+	NextGenerateCellIndex = 0;
+
+	if (bTimeSliceGeneration)
+	{
+		// continued each tick
+		bIsGeneratingBlocks = true;
+		SetActorTickEnabled(true);
+		return;
+	}
+
+	GenerateBlockAvatarsUntil(MAX_dbl);
+	OnBlocksGenerated();
+}
+
+bool APuzzleGrid::GenerateBlockAvatarsUntil(double EndTime)
+{
 	// generate all real blocks from the puzzle
-	for (const FPuzzleBlockDef& Block : PuzzleDef.Blocks)
+	while (NextGenerateBlockIndex < PuzzleDef.Blocks.Num())
 	{
-		CreateBlockAvatar(Block);
+		CreateBlockAvatar(PuzzleDef.Blocks[NextGenerateBlockIndex++]);
+
+		if (FPlatformTime::Seconds() >= EndTime)
+		{
+			return false;
+		}
 	}
 
 	// generate any empty blocks
 	if (bGenerateEmptyBlocks)
 	{
-		for (int32 X = 0; X < PuzzleDef.Dimensions.X; ++X)
+		const int32 NumCells = PuzzleDef.GetNumCells();
+		while (NextGenerateCellIndex < NumCells)
 		{
-			for (int32 Y = 0; Y < PuzzleDef.Dimensions.Y; ++Y)
+			const int32 CellIndex = NextGenerateCellIndex++;
+			if (!GetBlockAtCellIndex(CellIndex))
 			{
-				for (int32 Z = 0; Z < PuzzleDef.Dimensions.Z; ++Z)
+				FPuzzleBlockDef EmptyBlock;
+				EmptyBlock.Type = EmptyBlockType;
+				EmptyBlock.Position = PuzzleDef.GetCellPosition(CellIndex);
+				CreateBlockAvatar(EmptyBlock);
+
+				if (FPlatformTime::Seconds() >= EndTime)
 				{
-					const FIntVector Position(X, Y, Z);
-					if (!GetBlockAtPosition(Position))
-					{
-						FPuzzleBlockDef EmptyBlock;
-						EmptyBlock.Type = EmptyBlockType;
-						EmptyBlock.Position = Position;
-						CreateBlockAvatar(EmptyBlock);
-					}
+					return false;
 				}
 			}
 		}
 	}
+
+	return true;
+}
+
+void APuzzleGrid::OnBlocksGenerated()
+{
+	bIsGeneratingBlocks = false;
+
+	RebuildBlockExposure();
+
+	OnGenerationProgressEvent.Broadcast(1.f);
+	OnBlocksGeneratedEvent.Broadcast();
+	OnBlocksGeneratedEvent_BP.Broadcast();
+}
+
+float APuzzleGrid::GetGenerationProgress() const
+{
+	if (!bIsGeneratingBlocks)
+	{
+		return 1.f;
+	}
+
+	const int32 NumToGenerate = PuzzleDef.Blocks.Num() + (bGenerateEmptyBlocks ? PuzzleDef.GetNumCells() : 0);
+	const int32 NumGenerated = NextGenerateBlockIndex + NextGenerateCellIndex;
+	return NumToGenerate > 0 ? FMath::Clamp(static_cast<float>(NumGenerated) / NumToGenerate, 0.f, 1.f) : 1.f;
 }
 
 void APuzzleGrid::RegenerateBlockAvatars()
@@ -228,12 +435,34 @@ void APuzzleGrid::DestroyBlockAvatars()
 	{
 		if (BlockAvatar)
 		{
-			BlockAvatar->Destroy();
+			ReleaseBlockAvatar(BlockAvatar);
 		}
 	}
 
 	BlockAvatars.Empty();
 	BlocksByPosition.Empty();
+	NumIndexedBlockAvatars = 0;
+	BlockIndexDimensions = FIntVector::ZeroValue;
+
+	// cancel any generation in progress
+	bIsGeneratingBlocks = false;
+
+	// instanced components are kept around to be reused by the next puzzle
+	RebuildBlockInstances();
+}
+
+void APuzzleGrid::EmptyBlockAvatarPool()
+{
+	for (APuzzleBlockAvatar* BlockAvatar : BlockAvatarPool)
+	{
+		if (BlockAvatar)
+		{
+			BlockAvatar->Destroy();
+		}
+	}
+
+	DEC_DWORD_STAT_BY(STAT_PicrossPooledBlockAvatars, BlockAvatarPool.Num());
+	BlockAvatarPool.Empty();
 }
 
 void APuzzleGrid::SetSlicerPosition(int32 Axis, int32 Position)
@@ -308,16 +537,34 @@ void APuzzleGrid::SetPuzzleRotation(float Pitch, float Yaw)
 {
 	RotatePitch = FMath::ClampAngle(Pitch, -MaxPitchAngle, MaxPitchAngle);
 	RotateYaw = FRotator::NormalizeAxis(Yaw);
+
+	SetActorTickEnabled(true);
 }
 
 void APuzzleGrid::AddRotateRightInput(float Value)
 {
 	RotateRightInput += Value;
+
+	if (Value != 0.f)
+	{
+		SetActorTickEnabled(true);
+	}
 }
 
 void APuzzleGrid::AddRotateUpInput(float Value)
 {
 	RotateUpInput += Value;
+
+	if (Value != 0.f)
+	{
+		SetActorTickEnabled(true);
+	}
+}
+
+void APuzzleGrid::RequestLayoutUpdate()
+{
+	bIsLayoutDirty = true;
+	SetActorTickEnabled(true);
 }
 
 FVector APuzzleGrid::GetBlockSize() const
@@ -327,9 +574,117 @@ FVector APuzzleGrid::GetBlockSize() const
 
 APuzzleBlockAvatar* APuzzleGrid::GetBlockAtPosition(const FIntVector& Position) const
 {
-	if (BlocksByPosition.Contains(Position.ToString()))
+	if (PuzzleDef.IsValidPosition(Position) && BlockIndexDimensions == PuzzleDef.Dimensions)
+	{
+		return BlocksByPosition[PuzzleDef.GetCellIndex(Position)];
+	}
+	return nullptr;
+}
+
+APuzzleBlockAvatar* APuzzleGrid::TraceForBlock(const FVector& WorldOrigin, const FVector& WorldDirection,
+                                              float MaxDistance, FIntVector& OutPosition) const
+{
+	OutPosition = FIntVector::NoneValue;
+	if (BlockIndexDimensions != PuzzleDef.Dimensions || PuzzleDef.GetNumCells() <= 0)
+	{
+		return nullptr;
+	}
+
+	// convert the ray to cell space, where each cell is a unit cube and the grid spans [0, Dimensions).
+	// distances along the ray stay in world units, since the direction is converted without normalizing.
+	const FVector BlockSize = GetBlockSize();
+	const FVector GridMin = FVector(PuzzleDef.Dimensions) * BlockSize * -0.5f;
+	const FTransform& GridTransform = GetActorTransform();
+	const FVector Origin = (GridTransform.InverseTransformPosition(WorldOrigin) - GridMin) / BlockSize;
+	const FVector Direction = GridTransform.InverseTransformVector(WorldDirection.GetSafeNormal()) / BlockSize;
+
+	// find where the ray enters and leaves the grid bounds
+	float EnterDist = 0.f;
+	float ExitDist = MaxDistance;
+	for (int32 Axis = 0; Axis <= 2; ++Axis)
+	{
+		const float Dimension = PuzzleDef.Dimensions[Axis];
+		if (FMath::IsNearlyZero(Direction[Axis]))
+		{
+			if (Origin[Axis] < 0.f || Origin[Axis] >= Dimension)
+			{
+				return nullptr;
+			}
+			continue;
+		}
+
+		float NearDist = -Origin[Axis] / Direction[Axis];
+		float FarDist = (Dimension - Origin[Axis]) / Direction[Axis];
+		if (NearDist > FarDist)
+		{
+			Swap(NearDist, FarDist);
+		}
+		EnterDist = FMath::Max(EnterDist, NearDist);
+		ExitDist = FMath::Min(ExitDist, FarDist);
+	}
+
+	if (EnterDist > ExitDist)
+	{
+		return nullptr;
+	}
+
+	// walk cells along the ray, stepping to whichever cell boundary is closest each time
+	const FVector EnterPoint = Origin + Direction * EnterDist;
+	FIntVector Cell;
+	FIntVector Step;
+	FVector NextDist;
+	FVector DeltaDist;
+	for (int32 Axis = 0; Axis <= 2; ++Axis)
+	{
+		Cell[Axis] = FMath::Clamp(FMath::FloorToInt(EnterPoint[Axis]), 0, PuzzleDef.Dimensions[Axis] - 1);
+		if (FMath::IsNearlyZero(Direction[Axis]))
+		{
+			Step[Axis] = 0;
+			NextDist[Axis] = BIG_NUMBER;
+			DeltaDist[Axis] = BIG_NUMBER;
+		}
+		else
+		{
+			Step[Axis] = Direction[Axis] > 0.f ? 1 : -1;
+			const float Boundary = Cell[Axis] + (Step[Axis] > 0 ? 1.f : 0.f);
+			NextDist[Axis] = (Boundary - Origin[Axis]) / Direction[Axis];
+			DeltaDist[Axis] = FMath::Abs(1.f / Direction[Axis]);
+		}
+	}
+
+	while (PuzzleDef.IsValidPosition(Cell))
+	{
+		APuzzleBlockAvatar* BlockAvatar = GetBlockAtCellIndex(PuzzleDef.GetCellIndex(Cell));
+		if (BlockAvatar && BlockAvatar->IsBlockVisible())
+		{
+			OutPosition = Cell;
+			return BlockAvatar;
+		}
+
+		const int32 StepAxis = NextDist.X < NextDist.Y
+			                       ? (NextDist.X < NextDist.Z ? 0 : 2)
+			                       : (NextDist.Y < NextDist.Z ? 1 : 2);
+		if (NextDist[StepAxis] > ExitDist)
+		{
+			break;
+		}
+		Cell[StepAxis] += Step[StepAxis];
+		NextDist[StepAxis] += DeltaDist[StepAxis];
+	}
+
+	return nullptr;
+}
+
+APuzzleBlockAvatar* APuzzleGrid::GetBlockAtInstance(const UPrimitiveComponent* Component, int32 InstanceIndex) const
+{
+	for (const FPuzzleBlockInstanceBucket& Bucket : BlockInstanceBuckets)
 	{
-		return BlocksByPosition[Position.ToString()];
+		if (Bucket.Component && Bucket.Component == Component)
+		{
+			return Bucket.InstanceCells.IsValidIndex(InstanceIndex)
+				       ? GetBlockAtCellIndex(Bucket.InstanceCells[InstanceIndex])
+				       : nullptr;
+		}
 	}
 	return nullptr;
 }
@@ -357,17 +712,13 @@ void APuzzleGrid::GetCameraAlignedAxis(int32& OutAxis, int32& OutSign) const
 
 APuzzleBlockAvatar* APuzzleGrid::CreateBlockAvatar(const FPuzzleBlockDef& Block)
 {
-	FActorSpawnParameters SpawnParameters;
-	SpawnParameters.Owner = this;
-	SpawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
-	SpawnParameters.ObjectFlags = RF_Transient;
-
-	APuzzleBlockAvatar* BlockAvatar = GetWorld()->SpawnActor<APuzzleBlockAvatar>(BlockAvatarClass, SpawnParameters);
+	APuzzleBlockAvatar* BlockAvatar = AcquireBlockAvatar();
 	if (BlockAvatar)
 	{
 		BlockAvatar->AttachToComponent(GetRootComponent(), FAttachmentTransformRules::SnapToTargetIncludingScale);
 		BlockAvatar->SetActorRelativeLocation(CalculateBlockLocation(Block.Position));
 		BlockAvatar->BlockMeshSet = BlockMeshSet;
+		BlockAvatar->SetIsInstanced(bUseInstancedBlocks);
 		BlockAvatar->SetBlock(Block);
 		BlockAvatar->SetState(DefaultBlockState);
 		BlockAvatar->OnIdentifyAttemptEvent.AddUObject(this, &APuzzleGrid::OnBlockIdentifyAttempt, BlockAvatar);
@@ -377,12 +728,359 @@ APuzzleBlockAvatar* APuzzleGrid::CreateBlockAvatar(const FPuzzleBlockDef& Block)
 		BlockAvatar->SetIsBlockHidden(!bVisible, false);
 
 		BlockAvatars.Add(BlockAvatar);
-		BlocksByPosition.Add(Block.Position.ToString(), BlockAvatar);
+		if (PuzzleDef.IsValidPosition(Block.Position) && BlockIndexDimensions == PuzzleDef.Dimensions)
+		{
+			APuzzleBlockAvatar*& IndexedAvatar = BlocksByPosition[PuzzleDef.GetCellIndex(Block.Position)];
+			if (!IndexedAvatar)
+			{
+				++NumIndexedBlockAvatars;
+			}
+			IndexedAvatar = BlockAvatar;
+		}
+
+		BlockAvatar->OnDisplayChangedEvent.AddUObject(this, &APuzzleGrid::OnBlockDisplayChanged);
+		OnBlockDisplayChanged(BlockAvatar);
 	}
 
 	return BlockAvatar;
 }
 
+APuzzleBlockAvatar* APuzzleGrid::AcquireBlockAvatar()
+{
+	while (BlockAvatarPool.Num() > 0)
+	{
+		APuzzleBlockAvatar* BlockAvatar = BlockAvatarPool.Pop(false);
+		DEC_DWORD_STAT(STAT_PicrossPooledBlockAvatars);
+
+		if (!IsValid(BlockAvatar))
+		{
+			continue;
+		}
+
+		// the avatar class may have changed since the avatar was pooled
+		if (BlockAvatar->GetClass() != GetBlockAvatarClass())
+		{
+			BlockAvatar->Destroy();
+			continue;
+		}
+
+		BlockAvatar->SetActorHiddenInGame(false);
+		BlockAvatar->SetActorEnableCollision(bEnableBlockCollision);
+		INC_DWORD_STAT(STAT_PicrossBlockAvatarsReused);
+		return BlockAvatar;
+	}
+
+	FActorSpawnParameters SpawnParameters;
+	SpawnParameters.Owner = this;
+	SpawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	SpawnParameters.ObjectFlags = RF_Transient;
+
+	APuzzleBlockAvatar* BlockAvatar = GetWorld()->SpawnActor<APuzzleBlockAvatar>(GetBlockAvatarClass(), SpawnParameters);
+	if (BlockAvatar)
+	{
+		BlockAvatar->SetActorEnableCollision(bEnableBlockCollision);
+		INC_DWORD_STAT(STAT_PicrossBlockAvatarsSpawned);
+	}
+	return BlockAvatar;
+}
+
+void APuzzleGrid::ReleaseBlockAvatar(APuzzleBlockAvatar* BlockAvatar)
+{
+	if (!bPoolBlockAvatars || !IsValid(BlockAvatar) || BlockAvatar->IsActorBeingDestroyed())
+	{
+		if (BlockAvatar)
+		{
+			BlockAvatar->Destroy();
+		}
+		return;
+	}
+
+	BlockAvatar->ResetBlock();
+	BlockAvatar->SetActorHiddenInGame(true);
+	BlockAvatar->SetActorEnableCollision(false);
+
+	BlockAvatarPool.Add(BlockAvatar);
+	INC_DWORD_STAT(STAT_PicrossPooledBlockAvatars);
+}
+
+void APuzzleGrid::RebuildBlockIndex()
+{
+	BlocksByPosition.Reset();
+	BlocksByPosition.SetNumZeroed(FMath::Max(PuzzleDef.GetNumCells(), 0));
+	NumIndexedBlockAvatars = 0;
+	BlockIndexDimensions = PuzzleDef.Dimensions;
+
+	for (APuzzleBlockAvatar* BlockAvatar : BlockAvatars)
+	{
+		if (BlockAvatar && PuzzleDef.IsValidPosition(BlockAvatar->Block.Position))
+		{
+			APuzzleBlockAvatar*& IndexedAvatar = BlocksByPosition[PuzzleDef.GetCellIndex(BlockAvatar->Block.Position)];
+			if (!IndexedAvatar)
+			{
+				++NumIndexedBlockAvatars;
+			}
+			IndexedAvatar = BlockAvatar;
+		}
+	}
+
+	// exposure is rebuilt once all blocks exist
+	OpaqueCells.Empty();
+	ExposedCells.Empty();
+	if (!bIsGeneratingBlocks && BlockAvatars.Num() > 0)
+	{
+		RebuildBlockExposure();
+	}
+
+	RebuildBlockInstances();
+}
+
+void APuzzleGrid::UpdateBlockInstance(APuzzleBlockAvatar* BlockAvatar)
+{
+	if (!bUseInstancedBlocks || !BlockAvatar || BlockIndexDimensions != PuzzleDef.Dimensions ||
+		!PuzzleDef.IsValidPosition(BlockAvatar->Block.Position))
+	{
+		return;
+	}
+
+	const int32 CellIndex = PuzzleDef.GetCellIndex(BlockAvatar->Block.Position);
+	if (BlocksByPosition[CellIndex] != BlockAvatar)
+	{
+		return;
+	}
+
+	// move the cell to the bucket for its current mesh
+	UStaticMesh* DisplayMesh = BlockAvatar->GetDisplayMesh();
+	const int32 BucketIndex = DisplayMesh ? FindOrAddBlockInstanceBucket(DisplayMesh) : INDEX_NONE;
+	if (CellInstances[CellIndex].BucketIndex != BucketIndex)
+	{
+		ReleaseBlockInstance(CellIndex);
+		if (BucketIndex == INDEX_NONE)
+		{
+			return;
+		}
+
+		FPuzzleBlockInstanceBucket& NewBucket = BlockInstanceBuckets[BucketIndex];
+		const int32 InstanceIndex = NewBucket.FreeInstances.Num() > 0
+			                            ? NewBucket.FreeInstances.Pop(false)
+			                            : NewBucket.Component->AddInstance(FTransform(FVector::ZeroVector));
+		if (InstanceIndex >= NewBucket.InstanceCells.Num())
+		{
+			NewBucket.InstanceCells.SetNum(InstanceIndex + 1);
+		}
+		NewBucket.InstanceCells[InstanceIndex] = CellIndex;
+
+		CellInstances[CellIndex].BucketIndex = BucketIndex;
+		CellInstances[CellIndex].InstanceIndex = InstanceIndex;
+	}
+
+	// hidden blocks are scaled to zero, so they are neither drawn nor hit by traces
+	UInstancedStaticMeshComponent* Component = BlockInstanceBuckets[BucketIndex].Component;
+	const int32 InstanceIndex = CellInstances[CellIndex].InstanceIndex;
+	const bool bIsDrawn = BlockAvatar->IsBlockVisible() && !BlockAvatar->bIsBlockOccluded;
+	const FVector Scale = bIsDrawn ? FVector::OneVector : FVector::ZeroVector;
+	const FTransform Transform(FQuat::Identity, CalculateBlockLocation(BlockAvatar->Block.Position), Scale);
+	Component->UpdateInstanceTransform(InstanceIndex, Transform, false, false, true);
+
+	Component->SetCustomDataValue(InstanceIndex, 0, static_cast<float>(BlockAvatar->State), false);
+	Component->SetCustomDataValue(InstanceIndex, 1, PuzzleDef.FindBlockTypeIndex(BlockAvatar->MarkedType), false);
+	Component->SetCustomDataValue(InstanceIndex, 2, BlockAvatar->bIsBlockHidden ? 1.f : 0.f, true);
+}
+
+void APuzzleGrid::OnBlockDisplayChanged(APuzzleBlockAvatar* BlockAvatar)
+{
+	UpdateBlockInstance(BlockAvatar);
+
+	if (OpaqueCells.Num() > 0 && PuzzleDef.IsValidPosition(BlockAvatar->Block.Position))
+	{
+		const int32 CellIndex = PuzzleDef.GetCellIndex(BlockAvatar->Block.Position);
+		if (BlocksByPosition[CellIndex] == BlockAvatar)
+		{
+			UpdateBlockExposure(CellIndex);
+		}
+	}
+}
+
+bool APuzzleGrid::IsCellOpaque(int32 CellIndex) const
+{
+	const APuzzleBlockAvatar* BlockAvatar = GetBlockAtCellIndex(CellIndex);
+	return BlockAvatar && BlockAvatar->IsBlockVisible();
+}
+
+bool APuzzleGrid::IsCellExposed(int32 CellIndex) const
+{
+	const FIntVector Position = PuzzleDef.GetCellPosition(CellIndex);
+	for (int32 Axis = 0; Axis <= 2; ++Axis)
+	{
+		const int32 Stride = PuzzleDef.GetCellStride(Axis);
+		if (Position[Axis] == 0 || !OpaqueCells[CellIndex - Stride] ||
+			Position[Axis] == PuzzleDef.Dimensions[Axis] - 1 || !OpaqueCells[CellIndex + Stride])
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void APuzzleGrid::RebuildBlockExposure()
+{
+	const int32 NumCells = PuzzleDef.GetNumCells();
+	if (BlockIndexDimensions != PuzzleDef.Dimensions || NumCells <= 0)
+	{
+		return;
+	}
+
+	// blocks outside the puzzle dimensions are never occluded
+	for (APuzzleBlockAvatar* BlockAvatar : BlockAvatars)
+	{
+		if (BlockAvatar && BlockAvatar->bIsBlockOccluded && !PuzzleDef.IsValidPosition(BlockAvatar->Block.Position))
+		{
+			BlockAvatar->SetActorEnableCollision(bEnableBlockCollision);
+			BlockAvatar->SetIsBlockOccluded(false);
+		}
+	}
+
+	OpaqueCells.Init(false, NumCells);
+	for (int32 CellIndex = 0; CellIndex < NumCells; ++CellIndex)
+	{
+		OpaqueCells[CellIndex] = IsCellOpaque(CellIndex);
+	}
+
+	ExposedCells.Init(false, NumCells);
+	for (int32 CellIndex = 0; CellIndex < NumCells; ++CellIndex)
+	{
+		ExposedCells[CellIndex] = IsCellExposed(CellIndex);
+		ApplyBlockExposure(CellIndex);
+	}
+}
+
+void APuzzleGrid::UpdateBlockExposure(int32 CellIndex)
+{
+	if (OpaqueCells.Num() == 0 || BlockIndexDimensions != PuzzleDef.Dimensions)
+	{
+		return;
+	}
+
+	const bool bIsOpaque = IsCellOpaque(CellIndex);
+	if (OpaqueCells[CellIndex] == bIsOpaque)
+	{
+		// neighbors are unaffected, but the block in this cell may be new
+		ApplyBlockExposure(CellIndex);
+		return;
+	}
+
+	OpaqueCells[CellIndex] = bIsOpaque;
+
+	// only this cell and its face neighbors can change exposure
+	const FIntVector Position = PuzzleDef.GetCellPosition(CellIndex);
+	TArray<int32, TInlineAllocator<7>> AffectedCells;
+	AffectedCells.Add(CellIndex);
+	for (int32 Axis = 0; Axis <= 2; ++Axis)
+	{
+		const int32 Stride = PuzzleDef.GetCellStride(Axis);
+		if (Position[Axis] > 0)
+		{
+			AffectedCells.Add(CellIndex - Stride);
+		}
+		if (Position[Axis] < PuzzleDef.Dimensions[Axis] - 1)
+		{
+			AffectedCells.Add(CellIndex + Stride);
+		}
+	}
+
+	for (const int32 AffectedCell : AffectedCells)
+	{
+		ExposedCells[AffectedCell] = IsCellExposed(AffectedCell);
+		ApplyBlockExposure(AffectedCell);
+	}
+}
+
+void APuzzleGrid::ApplyBlockExposure(int32 CellIndex)
+{
+	APuzzleBlockAvatar* BlockAvatar = GetBlockAtCellIndex(CellIndex);
+	if (!BlockAvatar)
+	{
+		return;
+	}
+
+	const bool bNewOccluded = bCullOccludedBlocks && !ExposedCells[CellIndex];
+	if (BlockAvatar->bIsBlockOccluded != bNewOccluded)
+	{
+		BlockAvatar->SetActorEnableCollision(bEnableBlockCollision && !bNewOccluded);
+		BlockAvatar->SetIsBlockOccluded(bNewOccluded);
+	}
+}
+
+void APuzzleGrid::ReleaseBlockInstance(int32 CellIndex)
+{
+	if (!CellInstances.IsValidIndex(CellIndex))
+	{
+		return;
+	}
+
+	FBlockInstanceId& InstanceId = CellInstances[CellIndex];
+	if (BlockInstanceBuckets.IsValidIndex(InstanceId.BucketIndex))
+	{
+		FPuzzleBlockInstanceBucket& Bucket = BlockInstanceBuckets[InstanceId.BucketIndex];
+		Bucket.Component->UpdateInstanceTransform(InstanceId.InstanceIndex, FTransform(FQuat::Identity,
+		                                          FVector::ZeroVector, FVector::ZeroVector), false, true, true);
+		Bucket.InstanceCells[InstanceId.InstanceIndex] = INDEX_NONE;
+		Bucket.FreeInstances.Add(InstanceId.InstanceIndex);
+	}
+
+	InstanceId = FBlockInstanceId();
+}
+
+void APuzzleGrid::RebuildBlockInstances()
+{
+	for (FPuzzleBlockInstanceBucket& Bucket : BlockInstanceBuckets)
+	{
+		if (Bucket.Component)
+		{
+			Bucket.Component->ClearInstances();
+		}
+		Bucket.InstanceCells.Reset();
+		Bucket.FreeInstances.Reset();
+	}
+
+	CellInstances.Reset();
+	CellInstances.SetNum(BlocksByPosition.Num());
+
+	if (bUseInstancedBlocks)
+	{
+		for (APuzzleBlockAvatar* BlockAvatar : BlocksByPosition)
+		{
+			UpdateBlockInstance(BlockAvatar);
+		}
+	}
+}
+
+int32 APuzzleGrid::FindOrAddBlockInstanceBucket(UStaticMesh* Mesh)
+{
+	for (int32 Idx = 0; Idx < BlockInstanceBuckets.Num(); ++Idx)
+	{
+		const UInstancedStaticMeshComponent* Component = BlockInstanceBuckets[Idx].Component;
+		if (Component && Component->GetStaticMesh() == Mesh)
+		{
+			return Idx;
+		}
+	}
+
+	UInstancedStaticMeshComponent* Component = NewObject<UInstancedStaticMeshComponent>(this, NAME_None, RF_Transient);
+	Component->SetStaticMesh(Mesh);
+	Component->NumCustomDataFloats = 3;
+	Component->SetCollisionProfileName(BlockInstanceCollisionProfile);
+	if (!bEnableBlockCollision)
+	{
+		Component->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	}
+	Component->SetupAttachment(GetRootComponent());
+	Component->RegisterComponent();
+
+	FPuzzleBlockInstanceBucket& Bucket = BlockInstanceBuckets.AddDefaulted_GetRef();
+	Bucket.Component = Component;
+	return BlockInstanceBuckets.Num() - 1;
+}
+
 FVector APuzzleGrid::CalculateBlockLocation(FIntVector Position) const
 {
 	const FVector BlockSize = GetBlockSize();
@@ -447,6 +1145,10 @@ void APuzzleGrid::CreateSlicerHandles()
 			}
 		}
 	}
+
+	// position the new handles
+	SlicerLayoutKey = INDEX_NONE;
+	RequestLayoutUpdate();
 }
 
 void APuzzleGrid::OnSlicerHandlePositionChanged(int32 NewPosition, APuzzleGridSlicerHandle* SlicerHandle)
@@ -474,12 +1176,101 @@ void APuzzleGrid::OnSlicerChanged()
 	}
 
 	// update block visibility based on slicing
-	for (APuzzleBlockAvatar* BlockAvatar : BlockAvatars)
+	UpdateSlicedBlocks();
+}
+
+void APuzzleGrid::UpdateSlicedBlocks()
+{
+	// avatars outside the puzzle dimensions, or sharing a cell, can only be reached by updating every block
+	const bool bHasUnindexedBlocks = NumIndexedBlockAvatars != BlockAvatars.Num();
+	if (AppliedSlicerDimensions != PuzzleDef.Dimensions || BlockIndexDimensions != PuzzleDef.Dimensions ||
+		bHasUnindexedBlocks)
 	{
-		check(BlockAvatar);
+		// layers no longer line up, update every block
+		for (APuzzleBlockAvatar* BlockAvatar : BlockAvatars)
+		{
+			check(BlockAvatar);
 
-		const bool bVisible = IsBlockVisibleWithSlicing(BlockAvatar->Block.Position);
-		BlockAvatar->SetIsBlockHidden(!bVisible);
+			const bool bVisible = IsBlockVisibleWithSlicing(BlockAvatar->Block.Position);
+			BlockAvatar->SetIsBlockHidden(!bVisible);
+		}
+	}
+	else if (AppliedSlicerAxis != SlicerAxis || AppliedSlicerPosition != SlicerPosition)
+	{
+		int32 OldStart, OldEnd, NewStart, NewEnd;
+		GetSlicedLayers(AppliedSlicerAxis, AppliedSlicerPosition, OldStart, OldEnd);
+		GetSlicedLayers(SlicerAxis, SlicerPosition, NewStart, NewEnd);
+
+		if (AppliedSlicerAxis == SlicerAxis)
+		{
+			// only layers sliced before or after, but not both, have changed
+			const int32 Dimension = PuzzleDef.Dimensions[SlicerAxis];
+			for (int32 Layer = 0; Layer < Dimension; ++Layer)
+			{
+				const bool bWasSliced = Layer >= OldStart && Layer < OldEnd;
+				const bool bIsSliced = Layer >= NewStart && Layer < NewEnd;
+				if (bWasSliced != bIsSliced)
+				{
+					UpdateSlicedBlocksInLayer(SlicerAxis, Layer);
+				}
+			}
+		}
+		else
+		{
+			for (int32 Layer = OldStart; Layer < OldEnd; ++Layer)
+			{
+				UpdateSlicedBlocksInLayer(AppliedSlicerAxis, Layer);
+			}
+			for (int32 Layer = NewStart; Layer < NewEnd; ++Layer)
+			{
+				UpdateSlicedBlocksInLayer(SlicerAxis, Layer);
+			}
+		}
+	}
+
+	AppliedSlicerAxis = SlicerAxis;
+	AppliedSlicerPosition = SlicerPosition;
+	AppliedSlicerDimensions = PuzzleDef.Dimensions;
+}
+
+void APuzzleGrid::UpdateSlicedBlocksInLayer(int32 Axis, int32 Layer)
+{
+	int32 AxisA, AxisB;
+	FPuzzleRow::GetOtherAxes(Axis, AxisA, AxisB);
+
+	FIntVector Position;
+	Position[Axis] = Layer;
+	for (Position[AxisA] = 0; Position[AxisA] < PuzzleDef.Dimensions[AxisA]; ++Position[AxisA])
+	{
+		for (Position[AxisB] = 0; Position[AxisB] < PuzzleDef.Dimensions[AxisB]; ++Position[AxisB])
+		{
+			APuzzleBlockAvatar* BlockAvatar = GetBlockAtCellIndex(PuzzleDef.GetCellIndex(Position));
+			if (BlockAvatar)
+			{
+				BlockAvatar->SetIsBlockHidden(!IsBlockVisibleWithSlicing(Position));
+			}
+		}
+	}
+}
+
+void APuzzleGrid::GetSlicedLayers(int32 Axis, int32 Position, int32& OutStart, int32& OutEnd) const
+{
+	OutStart = 0;
+	OutEnd = 0;
+	if (Axis < 0 || Axis > 2 || Position == 0)
+	{
+		return;
+	}
+
+	const int32 Dimension = PuzzleDef.Dimensions[Axis];
+	if (Position > 0)
+	{
+		OutEnd = FMath::Min(Position, Dimension);
+	}
+	else
+	{
+		OutStart = FMath::Max(Dimension + Position, 0);
+		OutEnd = Dimension;
 	}
 }
 
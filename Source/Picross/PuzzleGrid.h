@@ -9,9 +9,39 @@
 
 #include "PuzzleGrid.generated.h"
 
+class APlayerCameraManager;
 class APuzzleBlockAvatar;
 class APuzzleGridSlicerHandle;
+class UInstancedStaticMeshComponent;
 class UPuzzleBlockMeshSet;
+class UStaticMesh;
+
+
+/**
+ * All instances of a single block mesh drawn by a puzzle grid.
+ * Instances are never removed, so that instance indices stay stable,
+ * unused instances are scaled to zero and reused later.
+ */
+USTRUCT()
+struct FPuzzleBlockInstanceBucket
+{
+	GENERATED_BODY()
+
+	FPuzzleBlockInstanceBucket()
+		: Component(nullptr)
+	{
+	}
+
+	/** The component drawing every instance of the mesh */
+	UPROPERTY(Transient)
+	UInstancedStaticMeshComponent* Component;
+
+	/** The cell index drawn by each instance, or INDEX_NONE if the instance is unused */
+	TArray<int32> InstanceCells;
+
+	/** Unused instances that can be reused */
+	TArray<int32> FreeInstances;
+};
 
 
 /**
@@ -39,6 +69,13 @@ public:
 	UFUNCTION(BlueprintCallable)
 	void SetPuzzle(const FPuzzleDef& InPuzzle, bool bRegenerateBlocks = true);
 
+	/**
+	 * Change the type of a single block, updating the puzzle in place and only the block avatar at that position.
+	 * An invalid type removes the block from the puzzle, leaving an empty space.
+	 */
+	UFUNCTION(BlueprintCallable)
+	void SetBlockType(const FIntVector& Position, FGameplayTag NewBlockType);
+
 	/** The type to use when creating empty blocks */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	FGameplayTag EmptyBlockType;
@@ -57,6 +94,42 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	TSubclassOf<APuzzleBlockAvatar> BlockAvatarClass;
 
+	/** The block avatar class to use when drawing instanced blocks, which doesn't need a mesh component */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (EditCondition = "bUseInstancedBlocks"))
+	TSubclassOf<APuzzleBlockAvatar> InstancedBlockAvatarClass;
+
+	/** Return the block avatar class to spawn, depending on whether blocks are instanced */
+	FORCEINLINE TSubclassOf<APuzzleBlockAvatar> GetBlockAvatarClass() const
+	{
+		return bUseInstancedBlocks ? InstancedBlockAvatarClass : BlockAvatarClass;
+	}
+
+	/**
+	 * If true, draw blocks using one instanced mesh component per block mesh,
+	 * instead of a mesh component on every block avatar.
+	 * Instances have custom data for materials: 0 = block state, 1 = marked type index, 2 = hidden.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	bool bUseInstancedBlocks;
+
+	/**
+	 * If false, block avatars and instanced block meshes have no collision.
+	 * Blocks can still be found with TraceForBlock, which doesn't use collision.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	bool bEnableBlockCollision;
+
+	/**
+	 * If true, hide blocks that are completely surrounded by other visible blocks.
+	 * Blocks are shown again as soon as a neighbor is sliced away or identified as empty space.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	bool bCullOccludedBlocks;
+
+	/** The collision profile to use for instanced block meshes */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (EditCondition = "bUseInstancedBlocks"))
+	FName BlockInstanceCollisionProfile;
+
 	/** The slicer handle class to spawn */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	TSubclassOf<APuzzleGridSlicerHandle> SlicerHandleClass;
@@ -74,9 +147,33 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	float MaxPitchAngle;
 
+	/**
+	 * If true, stop ticking once rotation input has settled and the camera is still.
+	 * Rotation input, SetPuzzleRotation, and RequestLayoutUpdate start ticking again.
+	 * Disable this if the camera can move without notifying the grid.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	bool bSleepWhenIdle;
+
 	UFUNCTION(BlueprintCallable)
 	void GenerateBlockAvatars();
 
+	/** If true, generate block avatars over multiple frames instead of all at once */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	bool bTimeSliceGeneration;
+
+	/** The maximum time to spend generating block avatars each frame, in milliseconds */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (EditCondition = "bTimeSliceGeneration", ClampMin = "0.1"))
+	float GenerationBudgetMs;
+
+	/** Return true if block avatars are currently being generated over multiple frames */
+	UFUNCTION(BlueprintPure)
+	bool IsGeneratingBlocks() const { return bIsGeneratingBlocks; }
+
+	/** Return the fraction of block avatars that have been generated, 1 when finished */
+	UFUNCTION(BlueprintPure)
+	float GetGenerationProgress() const;
+
 	/** Return all block avatars in the grid */
 	const TArray<APuzzleBlockAvatar*>& GetBlockAvatars() const { return BlockAvatars; }
 
@@ -87,6 +184,18 @@ public:
 	UFUNCTION(BlueprintCallable)
 	void DestroyBlockAvatars();
 
+	/** If true, keep destroyed block avatars in a pool to be reused when generating blocks, instead of destroying them */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	bool bPoolBlockAvatars;
+
+	/** Return the number of block avatars in the pool waiting to be reused */
+	UFUNCTION(BlueprintPure)
+	int32 GetNumPooledBlockAvatars() const { return BlockAvatarPool.Num(); }
+
+	/** Destroy all block avatars in the pool */
+	UFUNCTION(BlueprintCallable)
+	void EmptyBlockAvatarPool();
+
 	/**
 	 * Set the current slicing position and axis.
 	 * Negative positions will slice from the back side of the grid.
@@ -125,12 +234,39 @@ public:
 	UFUNCTION(BlueprintCallable)
 	void AddRotateUpInput(float Value);
 
+	/** Update the grid rotation and slicer handle layout next tick, e.g. after moving the camera */
+	UFUNCTION(BlueprintCallable)
+	void RequestLayoutUpdate();
+
 	UFUNCTION(BlueprintPure)
 	FVector GetBlockSize() const;
 
 	UFUNCTION(BlueprintPure)
 	APuzzleBlockAvatar* GetBlockAtPosition(const FIntVector& Position) const;
 
+	/** Return the block avatar for a cell index of the current puzzle, see FPuzzleDef::GetCellIndex */
+	FORCEINLINE APuzzleBlockAvatar* GetBlockAtCellIndex(int32 CellIndex) const
+	{
+		return BlocksByPosition.IsValidIndex(CellIndex) ? BlocksByPosition[CellIndex] : nullptr;
+	}
+
+	/**
+	 * Find the first visible block along a world space ray by walking the cells of the grid.
+	 * Blocks hidden by slicing, and destroyed empty blocks, are skipped. Doesn't require block collision.
+	 * @param WorldOrigin The start of the ray
+	 * @param WorldDirection The direction of the ray
+	 * @param MaxDistance The maximum world distance along the ray to search
+	 * @param OutPosition The position of the block that was hit
+	 * @return The block avatar that was hit, or null if no visible block was hit
+	 */
+	UFUNCTION(BlueprintCallable)
+	APuzzleBlockAvatar* TraceForBlock(const FVector& WorldOrigin, const FVector& WorldDirection, float MaxDistance,
+	                                  FIntVector& OutPosition) const;
+
+	/** Return the block avatar drawn by an instance of an instanced block mesh component */
+	UFUNCTION(BlueprintPure)
+	APuzzleBlockAvatar* GetBlockAtInstance(const UPrimitiveComponent* Component, int32 InstanceIndex) const;
+
 	/** Return the axis and sign that is currently most aligned with the camera */
 	UFUNCTION(BlueprintCallable)
 	void GetCameraAlignedAxis(int32& OutAxis, int32& OutSign) const;
@@ -141,6 +277,27 @@ public:
 	/** Called when an attempt to identify a block has been made */
 	FBlockIdentifyAttemptDelegate OnBlockIdentifyAttemptEvent;
 
+	DECLARE_MULTICAST_DELEGATE_OneParam(FBlockTypeChangedDelegate, const FIntVector& /* Position */);
+
+	/** Called when the type of a single block has been changed with SetBlockType */
+	FBlockTypeChangedDelegate OnBlockTypeChangedEvent;
+
+	DECLARE_MULTICAST_DELEGATE_OneParam(FGenerationProgressDelegate, float /* Progress */);
+
+	/** Called each frame while block avatars are being generated over multiple frames */
+	FGenerationProgressDelegate OnGenerationProgressEvent;
+
+	DECLARE_MULTICAST_DELEGATE(FBlocksGeneratedDelegate);
+
+	/** Called when all block avatars have been generated */
+	FBlocksGeneratedDelegate OnBlocksGeneratedEvent;
+
+	DECLARE_DYNAMIC_MULTICAST_DELEGATE(FBlocksGeneratedDynDelegate);
+
+	/** Called when all block avatars have been generated */
+	UPROPERTY(BlueprintAssignable)
+	FBlocksGeneratedDynDelegate OnBlocksGeneratedEvent_BP;
+
 protected:
 	UPROPERTY(Transient)
 	int32 SlicerAxis;
@@ -148,6 +305,15 @@ protected:
 	UPROPERTY(Transient)
 	int32 SlicerPosition;
 
+	/** The slicer axis that block visibility was last updated for */
+	int32 AppliedSlicerAxis;
+
+	/** The slicer position that block visibility was last updated for */
+	int32 AppliedSlicerPosition;
+
+	/** The puzzle dimensions that block visibility was last updated for */
+	FIntVector AppliedSlicerDimensions;
+
 	/** Slicer handles for each axis, front and back */
 	UPROPERTY(Transient)
 	TArray<APuzzleGridSlicerHandle*> SlicerHandles;
@@ -163,6 +329,24 @@ protected:
 	/** The current pitch rotation of the puzzle */
 	float RotatePitch;
 
+	/** The camera manager of the first local player, used to keep the puzzle oriented towards the camera */
+	mutable TWeakObjectPtr<APlayerCameraManager> CachedCameraManager;
+
+	/** The camera rotation that the grid rotation and slicer handles were last updated for */
+	FQuat LayoutCameraRotation;
+
+	/** The grid rotation that slicer handles were last updated for */
+	FQuat LayoutGridRotation;
+
+	/** If true, update the grid rotation and slicer handles next tick even if nothing has moved */
+	bool bIsLayoutDirty;
+
+	/** Which side of the grid the camera was on along each axis when slicer handles were last positioned */
+	int32 SlicerLayoutKey;
+
+	/** The half size of the grid, including padding, when slicer handles were last positioned */
+	FVector SlicerLayoutHalfSize;
+
 	virtual void OnConstruction(const FTransform& Transform) override;
 	virtual void BeginPlay() override;
 	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
@@ -173,10 +357,67 @@ protected:
 	virtual void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
 #endif
 
+	APlayerCameraManager* GetPlayerCameraManager() const;
+
 	FRotator GetPlayerCameraRotation() const;
 
+	/**
+	 * Position and show or hide slicer handles so they face the camera.
+	 * Does nothing unless the camera moved to another side of the grid, or the grid size changed.
+	 */
+	void UpdateSlicerHandleLayout(const FVector& CameraVector);
+
 	APuzzleBlockAvatar* CreateBlockAvatar(const FPuzzleBlockDef& Block);
 
+	/**
+	 * Continue generating block avatars until done or out of time.
+	 * @param EndTime The platform time in seconds at which to stop
+	 * @return True if all block avatars have been generated
+	 */
+	bool GenerateBlockAvatarsUntil(double EndTime);
+
+	/** Called when all block avatars have been generated */
+	void OnBlocksGenerated();
+
+	/** Return a block avatar from the pool, or spawn a new one if none are available */
+	APuzzleBlockAvatar* AcquireBlockAvatar();
+
+	/** Reset a block avatar and return it to the pool, or destroy it if pooling is disabled */
+	void ReleaseBlockAvatar(APuzzleBlockAvatar* BlockAvatar);
+
+	/** Rebuild the index of block avatars by position for the current puzzle dimensions */
+	void RebuildBlockIndex();
+
+	/** Update the mesh instance drawing a block avatar to match its current display state */
+	void UpdateBlockInstance(APuzzleBlockAvatar* BlockAvatar);
+
+	/** Called when anything affecting how a block avatar is drawn has changed */
+	void OnBlockDisplayChanged(APuzzleBlockAvatar* BlockAvatar);
+
+	/** Return true if a cell contains a visible block, hiding the faces of its neighbors */
+	bool IsCellOpaque(int32 CellIndex) const;
+
+	/** Return true if any neighbor of a cell is outside the grid or doesn't contain a visible block */
+	bool IsCellExposed(int32 CellIndex) const;
+
+	/** Recalculate which cells are opaque and exposed, and occlude every hidden block */
+	void RebuildBlockExposure();
+
+	/** Update the opacity of a cell, and the exposure of the cell and its neighbors if it changed */
+	void UpdateBlockExposure(int32 CellIndex);
+
+	/** Update whether the block in a cell is occluded based on its exposure */
+	void ApplyBlockExposure(int32 CellIndex);
+
+	/** Stop drawing the mesh instance for a cell, and make the instance available for reuse */
+	void ReleaseBlockInstance(int32 CellIndex);
+
+	/** Remove all mesh instances and recreate them for every block avatar */
+	void RebuildBlockInstances();
+
+	/** Return the index of the instance bucket for a mesh, creating it if necessary */
+	int32 FindOrAddBlockInstanceBucket(UStaticMesh* Mesh);
+
 	/** Calculate the relative location to use for a block in the grid */
 	FVector CalculateBlockLocation(FIntVector Position) const;
 
@@ -191,6 +432,18 @@ protected:
 	/** Return true if a block at a position should be visible given the current slicer position */
 	bool IsBlockVisibleWithSlicing(FIntVector Position);
 
+	/**
+	 * Update the hidden state of blocks for the current slicer position.
+	 * Only the layers that were or are now sliced are updated.
+	 */
+	void UpdateSlicedBlocks();
+
+	/** Update the hidden state of all blocks in a single layer of the grid */
+	void UpdateSlicedBlocksInLayer(int32 Axis, int32 Layer);
+
+	/** Return the range of layers [OutStart, OutEnd) that are hidden by a slicer position along its axis */
+	void GetSlicedLayers(int32 Axis, int32 Position, int32& OutStart, int32& OutEnd) const;
+
 	void OnBlockIdentifyAttempt(FGameplayTag BlockType, APuzzleBlockAvatar* BlockAvatar);
 
 protected:
@@ -198,7 +451,52 @@ protected:
 	UPROPERTY(Transient)
 	TArray<APuzzleBlockAvatar*> BlockAvatars;
 
-	/** Map of all blocks in the grid by their position */
+	/** Block avatars that are not in use, hidden and waiting to be reused */
+	UPROPERTY(Transient)
+	TArray<APuzzleBlockAvatar*> BlockAvatarPool;
+
+	/** All blocks in the grid within the puzzle dimensions, indexed by cell index */
+	UPROPERTY(Transient)
+	TArray<APuzzleBlockAvatar*> BlocksByPosition;
+
+	/** The puzzle dimensions that BlocksByPosition was built for */
+	FIntVector BlockIndexDimensions;
+
+	/** The number of avatars in BlocksByPosition, fewer than BlockAvatars when some are outside the dimensions */
+	int32 NumIndexedBlockAvatars;
+
+	/** Are block avatars being generated over multiple frames? */
+	bool bIsGeneratingBlocks;
+
+	/** The index of the next block def to generate an avatar for */
+	int32 NextGenerateBlockIndex;
+
+	/** The index of the next cell to check for an empty block during generation */
+	int32 NextGenerateCellIndex;
+
+	/** Cells containing a visible block, indexed by cell index. Empty until all blocks have been generated. */
+	TBitArray<> OpaqueCells;
+
+	/** Cells with at least one face that isn't covered by a neighboring visible block, indexed by cell index */
+	TBitArray<> ExposedCells;
+
+	/** Instanced mesh components drawing blocks, one for each block mesh */
 	UPROPERTY(Transient)
-	TMap<FString, APuzzleBlockAvatar*> BlocksByPosition;
+	TArray<FPuzzleBlockInstanceBucket> BlockInstanceBuckets;
+
+	/** The bucket and instance index drawing a cell */
+	struct FBlockInstanceId
+	{
+		FBlockInstanceId()
+			: BucketIndex(INDEX_NONE),
+			  InstanceIndex(INDEX_NONE)
+		{
+		}
+
+		int32 BucketIndex;
+		int32 InstanceIndex;
+	};
+
+	/** The instance drawing each cell, indexed by cell index */
+	TArray<FBlockInstanceId> CellInstances;
 };
@@ -9,7 +9,12 @@
 APuzzleGridSlicerHandle::APuzzleGridSlicerHandle()
 	: Axis(0),
 	  bInvertPosition(false),
-	  Dimension(0)
+	  Dimension(0),
+	  BlockSize(FVector::ZeroVector),
+	  PrecisePosition(0.f),
+	  Position(0),
+	  bIsSlicerVisible(true),
+	  bIsDragging(false)
 {
 	PrimaryActorTick.bCanEverTick = true;
 }
@@ -45,6 +50,11 @@ void APuzzleGridSlicerHandle::SetAxisAndDimensions(int32 InAxis, int32 InDimensi
 
 void APuzzleGridSlicerHandle::SetSlicerVisible(bool bNewVisible)
 {
+	if (bIsSlicerVisible == bNewVisible)
+	{
+		return;
+	}
+
 	bIsSlicerVisible = bNewVisible;
 
 	SetActorHiddenInGame(!bIsSlicerVisible);
@@ -65,9 +65,13 @@ public:
 	UFUNCTION(BlueprintCallable)
 	void SetAxisAndDimensions(int32 InAxis, int32 InDimension, FVector InBlockSize);
 
+	/** Show or hide the slicer, doing nothing if the visibility hasn't changed */
 	UFUNCTION(BlueprintCallable)
 	void SetSlicerVisible(bool bNewVisible);
 
+	UFUNCTION(BlueprintPure)
+	bool IsSlicerVisible() const { return bIsSlicerVisible; }
+
 	UFUNCTION(BlueprintPure)
 	int32 GetMaxPosition() const;
 
@@ -0,0 +1,10 @@
+﻿// Copyright Bohdon Sayre.
+
+
+#include "PuzzleInstancedBlockAvatar.h"
+
+
+APuzzleInstancedBlockAvatar::APuzzleInstancedBlockAvatar(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer.DoNotCreateDefaultSubobject(MeshComponentName))
+{
+}
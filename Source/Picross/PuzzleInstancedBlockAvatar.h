@@ -0,0 +1,23 @@
+﻿// Copyright Bohdon Sayre.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "PuzzleBlockAvatar.h"
+
+#include "PuzzleInstancedBlockAvatar.generated.h"
+
+
+/**
+ * A block avatar without a mesh component, for grids that draw blocks as mesh instances.
+ * Saves spawning and registering a mesh component for every cell.
+ */
+UCLASS()
+class PICROSS_API APuzzleInstancedBlockAvatar : public APuzzleBlockAvatar
+{
+	GENERATED_BODY()
+
+public:
+	APuzzleInstancedBlockAvatar(const FObjectInitializer& ObjectInitializer);
+};
@@ -6,13 +6,25 @@
 #include "Picross.h"
 #include "PicrossGameModeBase.h"
 #include "PicrossGameSettings.h"
+#include "PuzzleAsyncSolver.h"
 #include "PuzzleBlockAvatar.h"
 #include "PuzzleGrid.h"
 #include "Kismet/GameplayStatics.h"
 
 
+DECLARE_CYCLE_STAT(TEXT("Refresh All Block Annotations"), STAT_PicrossRefreshAllBlockAnnotations, STATGROUP_Picross);
+DECLARE_CYCLE_STAT(TEXT("Refresh Dirty Block Annotations"), STAT_PicrossRefreshDirtyBlockAnnotations, STATGROUP_Picross);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Block Annotations Refreshed"), STAT_PicrossBlockAnnotationsRefreshed, STATGROUP_Picross);
+
+
 APuzzlePlayer::APuzzlePlayer()
-	: bIsStarted(false)
+	: bValidatePuzzle(true),
+	  bCanSolveByDeduction(false),
+	  Uniqueness(EPuzzleUniqueness::Unknown),
+	  bIsStarted(false),
+	  bIsStarting(false),
+	  NumUnidentifiedBlocks(0),
+	  NumRowTypes(0)
 {
 	Root = CreateDefaultSubobject<USceneComponent>(TEXT("Root"));
 	RootComponent = Root;
@@ -24,11 +36,19 @@ APuzzlePlayer::APuzzlePlayer()
 
 void APuzzlePlayer::Start()
 {
-	if (bIsStarted)
+	if (bIsStarted || bIsStarting)
 	{
 		return;
 	}
 
+	// results for any previous puzzle are no longer relevant
+	if (AsyncSolver.IsValid())
+	{
+		AsyncSolver->Cancel();
+	}
+	bCanSolveByDeduction = false;
+	Uniqueness = EPuzzleUniqueness::Unknown;
+
 	if (!PuzzleGrid)
 	{
 		PuzzleGrid = CreatePuzzleGrid();
@@ -38,11 +58,66 @@ void APuzzlePlayer::Start()
 		}
 	}
 
+	PuzzleDef.UpdateBlockGrid();
 	PuzzleGrid->SetPuzzle(PuzzleDef);
+
+	if (PuzzleGrid->IsGeneratingBlocks())
+	{
+		// wait for all blocks to exist before building solve state
+		bIsStarting = true;
+		return;
+	}
+
+	FinishStart();
+}
+
+void APuzzlePlayer::FinishStart()
+{
+	bIsStarting = false;
+
+	RebuildSolveState();
 	RegenerateAllAnnotations();
 	RefreshAllBlockAnnotations();
 
 	bIsStarted = true;
+
+	if (bValidatePuzzle)
+	{
+		ValidatePuzzle();
+	}
+}
+
+void APuzzlePlayer::ValidatePuzzle()
+{
+	if (!AsyncSolver.IsValid())
+	{
+		AsyncSolver = MakeShared<FPuzzleAsyncSolver, ESPMode::ThreadSafe>();
+		AsyncSolver->OnSolvedEvent.AddUObject(this, &APuzzlePlayer::OnPuzzleValidated);
+	}
+
+	AsyncSolver->Submit(PuzzleDef, Annotations, true);
+}
+
+void APuzzlePlayer::OnPuzzleValidated(const FPuzzleAsyncSolveResult& Result)
+{
+	bCanSolveByDeduction = Result.SolverResult.IsSolved();
+	Uniqueness = Result.Uniqueness;
+
+	if (Uniqueness == EPuzzleUniqueness::Unsolvable || Uniqueness == EPuzzleUniqueness::Ambiguous)
+	{
+		UE_LOG(LogPicross, Warning, TEXT("Puzzle annotations are %s, %d cells are ambiguous"),
+		       *UEnum::GetValueAsString(Uniqueness), Result.AmbiguousCells.Num());
+	}
+
+	OnPuzzleValidated_BP(bCanSolveByDeduction, Uniqueness);
+}
+
+void APuzzlePlayer::OnGridBlocksGenerated()
+{
+	if (bIsStarting)
+	{
+		FinishStart();
+	}
 }
 
 void APuzzlePlayer::SetPuzzleRotation(float Pitch, float Yaw)
@@ -62,32 +137,16 @@ void APuzzlePlayer::AddRotateUpInput(float Value)
 
 void APuzzlePlayer::BreakZeroRows()
 {
-	for (int32 X = 0; X < PuzzleDef.Dimensions.X; ++X)
+	for (int32 Axis = 0; Axis <= 2; ++Axis)
 	{
-		for (int32 Y = 0; Y < PuzzleDef.Dimensions.Y; ++Y)
+		const TArray<FPuzzleRowAnnotations>& AxisAnnotations = Annotations.GetAxisRowAnnotations(Axis);
+		for (int32 RowIndex = 0; RowIndex < AxisAnnotations.Num(); ++RowIndex)
 		{
-			for (int32 Z = 0; Z < PuzzleDef.Dimensions.Z; ++Z)
+			const FPuzzleRowAnnotations& RowAnnotations = AxisAnnotations[RowIndex];
+			if (RowAnnotations.bIsVisible && RowAnnotations.IsZeroAnnotation())
 			{
-				const FIntVector Position(X, Y, Z);
-				FPuzzleRowAnnotations RowAnnotations;
-
-				Annotations.GetRowAnnotations(FPuzzleRow(Position, 0), RowAnnotations);
-				if (RowAnnotations.bIsVisible && RowAnnotations.IsZeroAnnotation())
-				{
-					AutoIdentifyBlocksInRow(FPuzzleRow(Position, 0));
-				}
-
-				Annotations.GetRowAnnotations(FPuzzleRow(Position, 1), RowAnnotations);
-				if (RowAnnotations.bIsVisible && RowAnnotations.IsZeroAnnotation())
-				{
-					AutoIdentifyBlocksInRow(FPuzzleRow(Position, 1));
-				}
-
-				Annotations.GetRowAnnotations(FPuzzleRow(Position, 2), RowAnnotations);
-				if (RowAnnotations.bIsVisible && RowAnnotations.IsZeroAnnotation())
-				{
-					AutoIdentifyBlocksInRow(FPuzzleRow(Position, 2));
-				}
+				const int32 RowId = FPuzzleRow::MakeRowId(Axis, RowIndex);
+				AutoIdentifyBlocksInRow(FPuzzleRow::FromRowId(RowId, Annotations.Dimensions));
 			}
 		}
 	}
@@ -118,6 +177,11 @@ void APuzzlePlayer::RefreshAllBlockAnnotations()
 	{
 		return;
 	}
+
+	SCOPE_CYCLE_COUNTER(STAT_PicrossRefreshAllBlockAnnotations);
+
+	DirtyAnnotationRowIds.Reset();
+
 	for (int32 X = 0; X < PuzzleDef.Dimensions.X; ++X)
 	{
 		for (int32 Y = 0; Y < PuzzleDef.Dimensions.Y; ++Y)
@@ -132,31 +196,72 @@ void APuzzlePlayer::RefreshAllBlockAnnotations()
 					continue;
 				}
 
-				BlockAvatar->SetAnnotations(GetBlockAnnotations(Position));
-				BlockAvatar->SetAnnotationsVisible(true);
+				BlockAvatar->UpdateAnnotations(GetBlockAnnotations(Position), true);
 			}
 		}
 	}
+
+	INC_DWORD_STAT_BY(STAT_PicrossBlockAnnotationsRefreshed, PuzzleDef.GetNumCells());
 }
 
-bool APuzzlePlayer::IsRowIdentified(FPuzzleRow Row) const
+void APuzzlePlayer::RefreshDirtyBlockAnnotations()
 {
-	Row.Normalize();
-	if (Row.IsValid() && PuzzleGrid)
+	if (bIsSolved || !PuzzleGrid || DirtyAnnotationRowIds.Num() == 0)
 	{
-		FIntVector Pos = Row.Position;
+		DirtyAnnotationRowIds.Reset();
+		return;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_PicrossRefreshDirtyBlockAnnotations);
+
+	// blocks where dirty rows cross are only refreshed once
+	TBitArray<> RefreshedCells(false, PuzzleDef.GetNumCells());
+	int32 NumRefreshed = 0;
+
+	for (const int32 RowId : DirtyAnnotationRowIds)
+	{
+		const FPuzzleRow Row = FPuzzleRow::FromRowId(RowId, PuzzleDef.Dimensions);
+		FIntVector Position = Row.Position;
 		for (int32 Idx = 0; Idx < PuzzleDef.Dimensions[Row.Axis]; ++Idx)
 		{
-			Pos[Row.Axis] = Idx;
+			Position[Row.Axis] = Idx;
 
-			// TODO(bsayre): Use FPuzzleBlock instead of block avatars
-			APuzzleBlockAvatar* BlockAvatar = PuzzleGrid->GetBlockAtPosition(Pos);
-			if (BlockAvatar && !BlockAvatar->IsIdentified())
+			const int32 CellIdx = PuzzleDef.GetCellIndex(Position);
+			if (RefreshedCells[CellIdx])
+			{
+				continue;
+			}
+			RefreshedCells[CellIdx] = true;
+
+			APuzzleBlockAvatar* BlockAvatar = PuzzleGrid->GetBlockAtCellIndex(CellIdx);
+			if (BlockAvatar)
 			{
-				return false;
+				BlockAvatar->SetAnnotations(GetBlockAnnotations(Position));
+				++NumRefreshed;
 			}
 		}
-		return true;
+	}
+
+	DirtyAnnotationRowIds.Reset();
+
+	INC_DWORD_STAT_BY(STAT_PicrossBlockAnnotationsRefreshed, NumRefreshed);
+	UE_LOG(LogPicross, Verbose, TEXT("Refreshed annotations for %d blocks"), NumRefreshed);
+}
+
+bool APuzzlePlayer::IsRowIdentified(FPuzzleRow Row) const
+{
+	Row.Normalize();
+	if (Row.IsValid() && PuzzleGrid)
+	{
+		if (!Row.IsWithinDimensions(PuzzleDef.Dimensions))
+		{
+			// no blocks outside the puzzle
+			return true;
+		}
+
+		const int32 RowIndex = Row.GetAxisRowIndex(PuzzleDef.Dimensions);
+		const TArray<int32>& Counts = RowUnidentifiedCounts[Row.Axis];
+		return !Counts.IsValidIndex(RowIndex) || Counts[RowIndex] == 0;
 	}
 	return false;
 }
@@ -166,19 +271,17 @@ bool APuzzlePlayer::IsRowTypeIdentified(FPuzzleRow Row, FGameplayTag BlockType)
 	Row.Normalize();
 	if (Row.IsValid() && PuzzleGrid)
 	{
-		FIntVector Pos = Row.Position;
-		for (int32 Idx = 0; Idx < PuzzleDef.Dimensions[Row.Axis]; ++Idx)
+		const uint8 TypeIdx = PuzzleDef.FindBlockTypeIndex(BlockType);
+		if (!Row.IsWithinDimensions(PuzzleDef.Dimensions) ||
+			(TypeIdx == 0 && BlockType != PuzzleGrid->EmptyBlockType))
 		{
-			Pos[Row.Axis] = Idx;
-
-			// TODO(bsayre): Use FPuzzleBlock instead of block avatars
-			APuzzleBlockAvatar* BlockAvatar = PuzzleGrid->GetBlockAtPosition(Pos);
-			if (BlockAvatar && BlockAvatar->Block.Type == BlockType && !BlockAvatar->IsIdentified())
-			{
-				return false;
-			}
+			// no blocks of this type in the row
+			return true;
 		}
-		return true;
+
+		const int32 CountIdx = Row.GetAxisRowIndex(PuzzleDef.Dimensions) * NumRowTypes + TypeIdx;
+		const TArray<int32>& Counts = RowTypeUnidentifiedCounts[Row.Axis];
+		return !Counts.IsValidIndex(CountIdx) || Counts[CountIdx] == 0;
 	}
 	return false;
 }
@@ -228,6 +331,16 @@ void APuzzlePlayer::BeginPlay()
 	Super::BeginPlay();
 }
 
+void APuzzlePlayer::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (AsyncSolver.IsValid())
+	{
+		AsyncSolver->Cancel();
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
 APuzzleGrid* APuzzlePlayer::CreatePuzzleGrid()
 {
 	FActorSpawnParameters SpawnParameters;
@@ -239,6 +352,7 @@ APuzzleGrid* APuzzlePlayer::CreatePuzzleGrid()
 	if (Grid)
 	{
 		Grid->OnBlockIdentifyAttemptEvent.AddUObject(this, &APuzzlePlayer::OnBlockIdentifyAttempt);
+		Grid->OnBlocksGeneratedEvent.AddUObject(this, &APuzzlePlayer::OnGridBlocksGenerated);
 	}
 	return Grid;
 }
@@ -259,26 +373,11 @@ void APuzzlePlayer::SetAllBlockAnnotationsVisible(bool bNewVisible)
 
 void APuzzlePlayer::CheckPuzzleSolved()
 {
-	if (!PuzzleGrid)
+	if (!PuzzleGrid || NumUnidentifiedBlocks > 0)
 	{
 		return;
 	}
 
-	for (int32 X = 0; X < PuzzleDef.Dimensions.X; ++X)
-	{
-		for (int32 Y = 0; Y < PuzzleDef.Dimensions.Y; ++Y)
-		{
-			for (int32 Z = 0; Z < PuzzleDef.Dimensions.Z; ++Z)
-			{
-				APuzzleBlockAvatar* BlockAvatar = PuzzleGrid->GetBlockAtPosition(FIntVector(X, Y, Z));
-				if (BlockAvatar && !BlockAvatar->IsIdentified())
-				{
-					return;
-				}
-			}
-		}
-	}
-
 	bIsSolved = true;
 
 	SetAllBlockAnnotationsVisible(false);
@@ -332,19 +431,103 @@ void APuzzlePlayer::OnBlockIdentifyAttempt(APuzzleBlockAvatar* BlockAvatar, FGam
 
 void APuzzlePlayer::OnBlockIdentified(APuzzleBlockAvatar* BlockAvatar)
 {
+	const FIntVector& Position = BlockAvatar->Block.Position;
+	if (!bIsStarted || !PuzzleGrid || PuzzleGrid->GetBlockAtPosition(Position) != BlockAvatar)
+	{
+		// not tracked by the solve state
+		return;
+	}
+
+	--NumUnidentifiedBlocks;
+
+	// update row counts, keeping track of rows that are now fully identified
+	bool bIsRowIdentified[3];
+	const uint8 TypeIdx = GetBlockTypeIndex(BlockAvatar);
+	for (int32 Axis = 0; Axis <= 2; ++Axis)
+	{
+		const int32 RowIndex = FPuzzleRow(Position, Axis).GetAxisRowIndex(PuzzleDef.Dimensions);
+		bIsRowIdentified[Axis] = --RowUnidentifiedCounts[Axis][RowIndex] == 0;
+
+		// annotations only display identified state for block types, not empty space
+		if (--RowTypeUnidentifiedCounts[Axis][RowIndex * NumRowTypes + TypeIdx] == 0 && TypeIdx != 0)
+		{
+			MarkRowAnnotationsDirty(FPuzzleRow(Position, Axis));
+		}
+	}
+
 	CheckPuzzleSolved();
 
-	CheckRowSolved(FPuzzleRow(BlockAvatar->Block.Position, 0));
-	CheckRowSolved(FPuzzleRow(BlockAvatar->Block.Position, 1));
-	CheckRowSolved(FPuzzleRow(BlockAvatar->Block.Position, 2));
+	for (int32 Axis = 0; Axis <= 2; ++Axis)
+	{
+		if (bIsRowIdentified[Axis])
+		{
+			OnRowIdentified(FPuzzleRow(Position, Axis));
+		}
+	}
 
 	if (!bIsSolved)
 	{
-		// TODO(bsayre): Update only changed block annotations
-		RefreshAllBlockAnnotations();
+		RefreshDirtyBlockAnnotations();
 	}
 }
 
 void APuzzlePlayer::OnRowIdentified(FPuzzleRow Row)
 {
+	CheckRowSolved(Row);
+}
+
+void APuzzlePlayer::MarkRowAnnotationsDirty(FPuzzleRow Row)
+{
+	Row.Normalize();
+	if (Row.IsWithinDimensions(PuzzleDef.Dimensions))
+	{
+		DirtyAnnotationRowIds.AddUnique(Row.GetRowId(PuzzleDef.Dimensions));
+	}
+}
+
+void APuzzlePlayer::RebuildSolveState()
+{
+	NumUnidentifiedBlocks = 0;
+	NumRowTypes = PuzzleDef.GetBlockTypes().Num() + 1;
+
+	for (int32 Axis = 0; Axis <= 2; ++Axis)
+	{
+		const int32 NumRows = FPuzzleRow::GetNumRowsForAxis(Axis, PuzzleDef.Dimensions);
+		RowUnidentifiedCounts[Axis].Reset(NumRows);
+		RowUnidentifiedCounts[Axis].AddZeroed(NumRows);
+		RowTypeUnidentifiedCounts[Axis].Reset(NumRows * NumRowTypes);
+		RowTypeUnidentifiedCounts[Axis].AddZeroed(NumRows * NumRowTypes);
+	}
+
+	if (!PuzzleGrid)
+	{
+		return;
+	}
+
+	const int32 NumCells = PuzzleDef.GetNumCells();
+	for (int32 CellIdx = 0; CellIdx < NumCells; ++CellIdx)
+	{
+		const APuzzleBlockAvatar* BlockAvatar = PuzzleGrid->GetBlockAtCellIndex(CellIdx);
+		if (!BlockAvatar || BlockAvatar->IsIdentified())
+		{
+			continue;
+		}
+
+		++NumUnidentifiedBlocks;
+
+		const FIntVector Position = PuzzleDef.GetCellPosition(CellIdx);
+		const uint8 TypeIdx = GetBlockTypeIndex(BlockAvatar);
+		for (int32 Axis = 0; Axis <= 2; ++Axis)
+		{
+			const int32 RowIndex = FPuzzleRow(Position, Axis).GetAxisRowIndex(PuzzleDef.Dimensions);
+			++RowUnidentifiedCounts[Axis][RowIndex];
+			++RowTypeUnidentifiedCounts[Axis][RowIndex * NumRowTypes + TypeIdx];
+		}
+	}
+}
+
+uint8 APuzzlePlayer::GetBlockTypeIndex(const APuzzleBlockAvatar* BlockAvatar) const
+{
+	// empty space avatars use a type that isn't in the puzzle, and fall into slot 0
+	return PuzzleDef.FindBlockTypeIndex(BlockAvatar->Block.Type);
 }
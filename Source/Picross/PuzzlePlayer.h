@@ -11,6 +11,8 @@
 
 class APuzzleBlockAvatar;
 class APuzzleGrid;
+class FPuzzleAsyncSolver;
+struct FPuzzleAsyncSolveResult;
 
 
 /**
@@ -36,6 +38,18 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	TSubclassOf<APuzzleGrid> PuzzleGridClass;
 
+	/** If true, check in the background that the annotations can be solved, and have exactly one solution */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	bool bValidatePuzzle;
+
+	/** Can the puzzle be fully solved by deduction from the annotations? Only valid once validated. */
+	UPROPERTY(Transient, BlueprintReadOnly)
+	bool bCanSolveByDeduction;
+
+	/** Whether the annotations have exactly one solution. Only valid once validated. */
+	UPROPERTY(Transient, BlueprintReadOnly)
+	EPuzzleUniqueness Uniqueness;
+
 	/** Start playing the puzzle */
 	UFUNCTION(BlueprintCallable)
 	void Start();
@@ -68,6 +82,10 @@ public:
 	UFUNCTION(BlueprintCallable)
 	void RefreshAllBlockAnnotations();
 
+	/** Refresh the annotations displayed for blocks in rows whose annotations have changed */
+	UFUNCTION(BlueprintCallable)
+	void RefreshDirtyBlockAnnotations();
+
 	/** Return true if all blocks in a row have been identified */
 	UFUNCTION(BlueprintCallable, BlueprintPure = false)
 	bool IsRowIdentified(FPuzzleRow Row) const;
@@ -87,6 +105,7 @@ public:
 	FPuzzleRowAnnotations GetRowAnnotation(FPuzzleRow Row) const;
 
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
 	/**
 	 * Called when the true form of all blocks in a row has been revealed.
@@ -101,11 +120,21 @@ public:
 	UFUNCTION(BlueprintImplementableEvent, meta = (DisplayName = "OnPuzzleSolved"))
 	void OnPuzzleSolved_BP();
 
+	/**
+	 * Called when the puzzle has been validated in the background after starting
+	 */
+	UFUNCTION(BlueprintImplementableEvent, meta = (DisplayName = "OnPuzzleValidated"))
+	void OnPuzzleValidated_BP(bool bNewCanSolveByDeduction, EPuzzleUniqueness NewUniqueness);
+
 protected:
 	/** Has the puzzle been started? */
 	UPROPERTY(Transient)
 	bool bIsStarted;
 
+	/** Is the puzzle waiting for the grid to finish generating blocks before starting? */
+	UPROPERTY(Transient)
+	bool bIsStarting;
+
 	/** Has the puzzle been solved? */
 	UPROPERTY(Transient)
 	bool bIsSolved;
@@ -118,9 +147,51 @@ protected:
 	UPROPERTY(Transient)
 	FPuzzleAnnotations Annotations;
 
+	/** The number of blocks in the puzzle that have not been identified yet */
+	int32 NumUnidentifiedBlocks;
+
+	/** The number of unidentified blocks in each row, indexed by axis, then by axis row index */
+	TArray<int32> RowUnidentifiedCounts[3];
+
+	/**
+	 * The number of unidentified blocks of each type in each row, indexed by axis,
+	 * then by axis row index * NumRowTypes + block type index
+	 */
+	TArray<int32> RowTypeUnidentifiedCounts[3];
+
+	/** The number of block type slots per row, one for empty space plus one for each block type */
+	int32 NumRowTypes;
+
+	/** Solves the puzzle in the background to validate it */
+	TSharedPtr<FPuzzleAsyncSolver, ESPMode::ThreadSafe> AsyncSolver;
+
+	/** Start validating the puzzle in the background, replacing any validation already running */
+	void ValidatePuzzle();
+
+	/** Called when the puzzle has been validated */
+	void OnPuzzleValidated(const FPuzzleAsyncSolveResult& Result);
+
+	/** Rows whose displayed annotations have changed since the last refresh, as packed row ids */
+	TArray<int32> DirtyAnnotationRowIds;
+
+	/** Mark a row as needing the annotations of its blocks refreshed */
+	void MarkRowAnnotationsDirty(FPuzzleRow Row);
+
+	/** Rebuild all unidentified block counts from the current state of the puzzle grid */
+	void RebuildSolveState();
+
+	/** Return the block type index of a block avatar used for solve state counts, 0 for empty space */
+	uint8 GetBlockTypeIndex(const APuzzleBlockAvatar* BlockAvatar) const;
+
 	/** Regenerate all annotations */
 	void RegenerateAllAnnotations();
 
+	/** Finish starting the puzzle once the grid has generated all blocks */
+	void FinishStart();
+
+	/** Called when the puzzle grid has finished generating blocks */
+	void OnGridBlocksGenerated();
+
 	APuzzleGrid* CreatePuzzleGrid();
 
 	void SetAllBlockAnnotationsVisible(bool bNewVisible);
@@ -132,7 +203,7 @@ protected:
 	 * Check if a row has been solved, and reveal the true form of blocks if so
 	 */
 	void CheckRowSolved(FPuzzleRow Row);
-	
+
 	/** Called when a block has been identified correctly */
 	void OnBlockIdentifyAttempt(APuzzleBlockAvatar* BlockAvatar, FGameplayTag BlockType);
 
@@ -0,0 +1,169 @@
+﻿// Copyright Bohdon Sayre.
+
+
+#include "PuzzleRowBitboard.h"
+
+
+namespace PuzzleRowBitboard
+{
+	/** Set Dst to Src shifted towards higher bits, across a multi-word bit set */
+	FORCEINLINE void ShiftUp(uint64* Dst, const uint64* Src, int32 Shift, int32 NumWords)
+	{
+		const int32 WordShift = Shift / 64;
+		const int32 BitShift = Shift % 64;
+		for (int32 Word = NumWords - 1; Word >= 0; --Word)
+		{
+			const int32 SrcWord = Word - WordShift;
+			uint64 Value = 0;
+			if (SrcWord >= 0)
+			{
+				Value = Src[SrcWord] << BitShift;
+				if (BitShift != 0 && SrcWord > 0)
+				{
+					Value |= Src[SrcWord - 1] >> (64 - BitShift);
+				}
+			}
+			Dst[Word] = Value;
+		}
+	}
+
+	/** Set Dst to Src shifted towards lower bits, across a multi-word bit set */
+	FORCEINLINE void ShiftDown(uint64* Dst, const uint64* Src, int32 Shift, int32 NumWords)
+	{
+		const int32 WordShift = Shift / 64;
+		const int32 BitShift = Shift % 64;
+		for (int32 Word = 0; Word < NumWords; ++Word)
+		{
+			const int32 SrcWord = Word + WordShift;
+			uint64 Value = 0;
+			if (SrcWord < NumWords)
+			{
+				Value = Src[SrcWord] >> BitShift;
+				if (BitShift != 0 && SrcWord + 1 < NumWords)
+				{
+					Value |= Src[SrcWord + 1] << (64 - BitShift);
+				}
+			}
+			Dst[Word] = Value;
+		}
+	}
+}
+
+
+bool FPuzzleRowBitboard::IntersectPlacements(uint64 CanBeType, uint64 CanBeOther, int32 Length,
+                                             int32 NumBlocks, int32 NumGroups,
+                                             uint64& OutCanBeType, uint64& OutCanBeOther,
+                                             TArray<uint64>& Scratch)
+{
+	using namespace PuzzleRowBitboard;
+
+	OutCanBeType = 0;
+	OutCanBeOther = 0;
+
+	if (NumGroups < 1 || NumGroups > NumBlocks || NumBlocks > Length || Length > MaxCells ||
+		CountBlocks(CanBeType) < NumBlocks)
+	{
+		return false;
+	}
+
+	// a state is (blocks placed, groups started), stored as bit Blocks * (NumGroups + 1) + Groups.
+	// each cell has two state sets, one for when the cell is the type, and one for when it isn't.
+	const int32 GroupStride = NumGroups + 1;
+	const int32 NumStates = (NumBlocks + 1) * GroupStride;
+	const int32 NumWords = (NumStates + 63) / 64;
+	const int32 EndState = NumBlocks * GroupStride + NumGroups;
+
+	// backward sets for every cell boundary, followed by the last-group mask, the valid state mask,
+	// the current and next forward sets, and two shifted sets
+	const int32 NumSetWords = 2 * NumWords;
+	const int32 NumScratchWords = (Length + 1) * NumSetWords + 8 * NumWords;
+	Scratch.Reset(NumScratchWords);
+	Scratch.AddZeroed(NumScratchWords);
+
+	uint64* Backward = Scratch.GetData();
+	uint64* LastGroupMask = Backward + (Length + 1) * NumSetWords;
+	uint64* ValidMask = LastGroupMask + NumWords;
+	uint64* Forward = ValidMask + NumWords;
+	uint64* NextForward = Forward + NumSetWords;
+	uint64* Shifted = NextForward + NumSetWords;
+
+	for (int32 Blocks = 0; Blocks <= NumBlocks; ++Blocks)
+	{
+		const int32 State = Blocks * GroupStride + NumGroups;
+		LastGroupMask[State / 64] |= 1ull << (State % 64);
+	}
+	for (int32 Word = 0; Word < NumWords; ++Word)
+	{
+		const int32 NumBits = FMath::Min(NumStates - Word * 64, 64);
+		ValidMask[Word] = NumBits >= 64 ? ~0ull : (1ull << NumBits) - 1;
+	}
+
+	// backward pass, find every state at each cell boundary that can still reach the end of the row.
+	// a type cell after a type cell places a block, a type cell after anything else also starts a group.
+	uint64* EndSet = Backward + Length * NumSetWords;
+	EndSet[EndState / 64] |= 1ull << (EndState % 64);
+	EndSet[NumWords + EndState / 64] |= 1ull << (EndState % 64);
+
+	for (int32 Cell = Length - 1; Cell >= 0; --Cell)
+	{
+		const uint64 TypeMask = 0ull - ((CanBeType >> Cell) & 1);
+		const uint64 OtherMask = 0ull - ((CanBeOther >> Cell) & 1);
+		const uint64* NextOther = Backward + (Cell + 1) * NumSetWords;
+		const uint64* NextType = NextOther + NumWords;
+		uint64* Other = Backward + Cell * NumSetWords;
+		uint64* Type = Other + NumWords;
+
+		ShiftDown(Shifted, NextType, GroupStride + 1, NumWords);
+		ShiftDown(Shifted + NumWords, NextType, GroupStride, NumWords);
+		for (int32 Word = 0; Word < NumWords; ++Word)
+		{
+			const uint64 ViaOther = NextOther[Word] & OtherMask;
+			Other[Word] = ViaOther | (Shifted[Word] & ~LastGroupMask[Word] & TypeMask);
+			Type[Word] = ViaOther | (Shifted[NumWords + Word] & TypeMask);
+		}
+	}
+
+	if (!(Backward[0] & 1))
+	{
+		return false;
+	}
+
+	// forward pass, a cell can be the type or not if a state reachable from the
+	// start of the row that made that choice can also reach the end of the row
+	Forward[0] = 1;
+	for (int32 Cell = 0; Cell < Length; ++Cell)
+	{
+		const uint64 TypeMask = 0ull - ((CanBeType >> Cell) & 1);
+		const uint64 OtherMask = 0ull - ((CanBeOther >> Cell) & 1);
+		const uint64* Other = Forward;
+		const uint64* Type = Forward + NumWords;
+		const uint64* BackOther = Backward + (Cell + 1) * NumSetWords;
+		const uint64* BackType = BackOther + NumWords;
+		uint64* NextOther = NextForward;
+		uint64* NextType = NextForward + NumWords;
+
+		for (int32 Word = 0; Word < NumWords; ++Word)
+		{
+			Shifted[NumWords + Word] = Other[Word] & ~LastGroupMask[Word];
+		}
+		ShiftUp(Shifted, Shifted + NumWords, GroupStride + 1, NumWords);
+		ShiftUp(Shifted + NumWords, Type, GroupStride, NumWords);
+
+		uint64 AnyType = 0;
+		uint64 AnyOther = 0;
+		for (int32 Word = 0; Word < NumWords; ++Word)
+		{
+			NextOther[Word] = (Other[Word] | Type[Word]) & OtherMask;
+			NextType[Word] = (Shifted[Word] | Shifted[NumWords + Word]) & ValidMask[Word] & TypeMask;
+			AnyOther |= NextOther[Word] & BackOther[Word];
+			AnyType |= NextType[Word] & BackType[Word];
+		}
+
+		OutCanBeOther |= static_cast<uint64>(AnyOther != 0) << Cell;
+		OutCanBeType |= static_cast<uint64>(AnyType != 0) << Cell;
+
+		Swap(Forward, NextForward);
+	}
+
+	return true;
+}
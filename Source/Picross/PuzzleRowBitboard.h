@@ -0,0 +1,122 @@
+﻿// Copyright Bohdon Sayre.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+
+/**
+ * A single row of puzzle cells stored as bit masks, one bit per cell.
+ * Each type has a mask of the cells that could be that type,
+ * where type 0 is empty space, and type N is block type N.
+ */
+struct PICROSS_API FPuzzleRowBitboard
+{
+	/** The maximum number of cells in a row */
+	static constexpr int32 MaxCells = 64;
+
+	/** The maximum number of types in a row, including empty space */
+	static constexpr int32 MaxTypes = 16;
+
+	FPuzzleRowBitboard()
+		: Length(0),
+		  NumTypes(0)
+	{
+		FMemory::Memzero(TypeMasks);
+	}
+
+	FPuzzleRowBitboard(int32 InLength, int32 InNumTypes)
+		: Length(InLength),
+		  NumTypes(InNumTypes)
+	{
+		FMemory::Memzero(TypeMasks);
+	}
+
+	/** The number of cells in the row */
+	int32 Length;
+
+	/** The number of types in the row, including empty space */
+	int32 NumTypes;
+
+	/** The cells that could be each type */
+	uint64 TypeMasks[MaxTypes];
+
+	/** Return a mask of all cells in a row of a length */
+	static FORCEINLINE uint64 MakeRowMask(int32 InLength)
+	{
+		return InLength >= MaxCells ? ~0ull : (1ull << InLength) - 1;
+	}
+
+	/** Return a mask of all cells in the row */
+	FORCEINLINE uint64 GetRowMask() const { return MakeRowMask(Length); }
+
+	/** Set the types a cell could be, bit 0 for empty space, and bit N for block type N */
+	FORCEINLINE void SetCellDomain(int32 Cell, uint16 Domain)
+	{
+		const uint64 CellBit = 1ull << Cell;
+		for (int32 TypeIdx = 0; TypeIdx < NumTypes; ++TypeIdx)
+		{
+			const uint64 TypeBit = 0ull - static_cast<uint64>((Domain >> TypeIdx) & 1);
+			TypeMasks[TypeIdx] = (TypeMasks[TypeIdx] & ~CellBit) | (CellBit & TypeBit);
+		}
+	}
+
+	/** Return the types a cell could be, bit 0 for empty space, and bit N for block type N */
+	FORCEINLINE uint16 GetCellDomain(int32 Cell) const
+	{
+		uint16 Domain = 0;
+		for (int32 TypeIdx = 0; TypeIdx < NumTypes; ++TypeIdx)
+		{
+			Domain |= static_cast<uint16>(((TypeMasks[TypeIdx] >> Cell) & 1) << TypeIdx);
+		}
+		return Domain;
+	}
+
+	/** Return a mask of cells that could be any type other than a type */
+	FORCEINLINE uint64 GetOtherMask(int32 ExcludedTypeIdx) const
+	{
+		uint64 Mask = 0;
+		for (int32 TypeIdx = 0; TypeIdx < NumTypes; ++TypeIdx)
+		{
+			Mask |= TypeIdx != ExcludedTypeIdx ? TypeMasks[TypeIdx] : 0;
+		}
+		return Mask;
+	}
+
+	/** Return a mask of cells that could be a block of any type */
+	FORCEINLINE uint64 GetMayBeFilledMask() const { return GetOtherMask(0); }
+
+	/** Return a mask of cells that cannot be empty space */
+	FORCEINLINE uint64 GetMustBeFilledMask() const { return ~TypeMasks[0] & GetRowMask(); }
+
+	/** Return true if every cell could still be at least one type */
+	FORCEINLINE bool IsConsistent() const { return GetOtherMask(INDEX_NONE) == GetRowMask(); }
+
+	/** Return the number of blocks in a mask */
+	static FORCEINLINE int32 CountBlocks(uint64 Mask) { return FMath::CountBits(Mask); }
+
+	/** Return a mask of the first cell of each connected group of blocks in a mask */
+	static FORCEINLINE uint64 GetGroupStarts(uint64 Mask) { return Mask & ~(Mask << 1); }
+
+	/** Return the number of connected groups of blocks in a mask */
+	static FORCEINLINE int32 CountGroups(uint64 Mask) { return FMath::CountBits(GetGroupStarts(Mask)); }
+
+	/**
+	 * Intersect every placement of a number of blocks, split into a number of groups, within a row.
+	 * All placements are evaluated together as bit sets of (blocks placed, groups started) states,
+	 * so the cost is linear in the row length rather than the number of placements.
+	 * @param CanBeType The cells that could be the type
+	 * @param CanBeOther The cells that could be something other than the type
+	 * @param Length The number of cells in the row
+	 * @param NumBlocks The number of blocks of the type in the row
+	 * @param NumGroups The number of connected groups of the type in the row
+	 * @param OutCanBeType The cells that are the type in at least one placement
+	 * @param OutCanBeOther The cells that are not the type in at least one placement
+	 * @param Scratch Working memory that can be reused between calls
+	 * @return False if no placement exists
+	 */
+	static bool IntersectPlacements(uint64 CanBeType, uint64 CanBeOther, int32 Length,
+	                                int32 NumBlocks, int32 NumGroups,
+	                                uint64& OutCanBeType, uint64& OutCanBeOther,
+	                                TArray<uint64>& Scratch);
+};
@@ -0,0 +1,732 @@
+﻿// Copyright Bohdon Sayre.
+
+
+#include "PuzzleSolver.h"
+
+#include "Picross.h"
+
+
+DECLARE_CYCLE_STAT(TEXT("Solve Puzzle"), STAT_PicrossSolvePuzzle, STATGROUP_Picross);
+DECLARE_CYCLE_STAT(TEXT("Check Puzzle Uniqueness"), STAT_PicrossCheckUniqueness, STATGROUP_Picross);
+
+
+float FPuzzleSolverResult::GetDifficulty() const
+{
+	if (!IsSolved())
+	{
+		return 0.f;
+	}
+
+	int32 TotalCellsFixed = 0;
+	float TotalWeight = 0.f;
+	for (const FPuzzleSolverStep& Step : Steps)
+	{
+		float RuleWeight = 1.f;
+		switch (Step.Rule)
+		{
+		case EPuzzleSolverRule::ZeroRow:
+		case EPuzzleSolverRule::FullRow:
+			RuleWeight = 1.f;
+			break;
+		case EPuzzleSolverRule::AbsentTypes:
+			RuleWeight = 2.f;
+			break;
+		case EPuzzleSolverRule::BlockCount:
+			RuleWeight = 3.f;
+			break;
+		case EPuzzleSolverRule::Placement:
+			RuleWeight = 5.f;
+			break;
+		}
+
+		// slicing to find and read an interior row takes extra effort
+		if (Step.bIsInteriorRow)
+		{
+			RuleWeight *= 1.5f;
+		}
+
+		TotalWeight += RuleWeight * Step.NumCellsFixed;
+		TotalCellsFixed += Step.NumCellsFixed;
+	}
+
+	return TotalCellsFixed > 0 ? TotalWeight / TotalCellsFixed : 0.f;
+}
+
+
+FPuzzleSolver::FPuzzleSolver()
+	: Dimensions(FIntVector::ZeroValue),
+	  NumTypeSlots(1),
+	  NumUnknownCells(0),
+	  RowQueueHead(0),
+	  bRecordSteps(true)
+{
+}
+
+bool FPuzzleSolver::Initialize(const FPuzzleAnnotations& InAnnotations)
+{
+	Dimensions = InAnnotations.Dimensions;
+	BlockTypes.Reset();
+	CellDomains.Reset();
+	NumTypeSlots = 1;
+	NumUnknownCells = 0;
+	RowQueue.Reset();
+	RowQueueHead = 0;
+	Result = FPuzzleSolverResult();
+
+	if (Dimensions.GetMin() <= 0 || Dimensions.GetMax() > MaxRowLength)
+	{
+		UE_LOG(LogPicross, Warning, TEXT("Cannot solve puzzle with dimensions %s"), *Dimensions.ToString());
+		return false;
+	}
+
+	// gather all block types from the annotations
+	for (int32 Axis = 0; Axis <= 2; ++Axis)
+	{
+		const TArray<FPuzzleRowAnnotations>& AxisAnnotations = InAnnotations.GetAxisRowAnnotations(Axis);
+		if (AxisAnnotations.Num() != FPuzzleRow::GetNumRowsForAxis(Axis, Dimensions))
+		{
+			UE_LOG(LogPicross, Warning, TEXT("Cannot solve puzzle, annotations do not match dimensions %s"),
+			       *Dimensions.ToString());
+			return false;
+		}
+
+		for (const FPuzzleRowAnnotations& RowAnnotations : AxisAnnotations)
+		{
+			for (const FPuzzleRowTypeAnnotation& TypeAnnotation : RowAnnotations.TypeAnnotations)
+			{
+				BlockTypes.AddUnique(TypeAnnotation.Type);
+			}
+		}
+	}
+
+	if (BlockTypes.Num() > MaxBlockTypes)
+	{
+		UE_LOG(LogPicross, Warning, TEXT("Cannot solve puzzle with %d block types"), BlockTypes.Num());
+		BlockTypes.Reset();
+		return false;
+	}
+
+	NumTypeSlots = BlockTypes.Num() + 1;
+
+	// store visibility and block counts for each row
+	for (int32 Axis = 0; Axis <= 2; ++Axis)
+	{
+		const TArray<FPuzzleRowAnnotations>& AxisAnnotations = InAnnotations.GetAxisRowAnnotations(Axis);
+		const int32 NumRows = AxisAnnotations.Num();
+
+		RowVisibility[Axis].Reset(NumRows);
+		RowQueued[Axis].Init(false, NumRows);
+		RowTypeCounts[Axis].Reset(NumRows * NumTypeSlots);
+		RowTypeCounts[Axis].AddZeroed(NumRows * NumTypeSlots);
+
+		for (int32 RowIndex = 0; RowIndex < NumRows; ++RowIndex)
+		{
+			const FPuzzleRowAnnotations& RowAnnotations = AxisAnnotations[RowIndex];
+			RowVisibility[Axis].Add(RowAnnotations.bIsVisible);
+
+			for (const FPuzzleRowTypeAnnotation& TypeAnnotation : RowAnnotations.TypeAnnotations)
+			{
+				const int32 TypeIdx = BlockTypes.IndexOfByKey(TypeAnnotation.Type) + 1;
+				FRowTypeCount& Count = RowTypeCounts[Axis][RowIndex * NumTypeSlots + TypeIdx];
+				Count.NumBlocks = static_cast<uint8>(FMath::Clamp(TypeAnnotation.NumBlocks, 0, MaxRowLength));
+				Count.NumGroups = static_cast<uint8>(FMath::Clamp(TypeAnnotation.NumGroups, 0, MaxRowLength));
+			}
+		}
+	}
+
+	// every cell starts out as any type
+	const int32 NumCells = Dimensions.X * Dimensions.Y * Dimensions.Z;
+	const uint16 AllTypes = static_cast<uint16>((1 << NumTypeSlots) - 1);
+	CellDomains.Init(AllTypes, NumCells);
+	NumUnknownCells = NumTypeSlots > 1 ? NumCells : 0;
+
+	return true;
+}
+
+bool FPuzzleSolver::SolvePuzzle()
+{
+	SCOPE_CYCLE_COUNTER(STAT_PicrossSolvePuzzle);
+
+	if (CellDomains.Num() == 0)
+	{
+		Result.State = EPuzzleSolverState::Stuck;
+		return false;
+	}
+
+	for (int32 Axis = 0; Axis <= 2; ++Axis)
+	{
+		for (int32 RowIndex = 0; RowIndex < RowVisibility[Axis].Num(); ++RowIndex)
+		{
+			QueueRow(Axis, RowIndex);
+		}
+	}
+
+	if (!Propagate())
+	{
+		Result.State = EPuzzleSolverState::Contradiction;
+		return false;
+	}
+
+	Result.State = NumUnknownCells == 0 ? EPuzzleSolverState::Solved : EPuzzleSolverState::Stuck;
+	return Result.IsSolved();
+}
+
+void FPuzzleSolver::GetSolution(FPuzzleDef& OutPuzzleDef) const
+{
+	OutPuzzleDef.Dimensions = Dimensions;
+	OutPuzzleDef.Blocks.Reset();
+
+	for (int32 CellIdx = 0; CellIdx < CellDomains.Num(); ++CellIdx)
+	{
+		const uint16 Domain = CellDomains[CellIdx];
+		if (FMath::IsPowerOfTwo(Domain) && Domain != 1)
+		{
+			FPuzzleBlockDef BlockDef;
+			BlockDef.Position = FIntVector(CellIdx / (Dimensions.Y * Dimensions.Z),
+			                               (CellIdx / Dimensions.Z) % Dimensions.Y,
+			                               CellIdx % Dimensions.Z);
+			BlockDef.Type = BlockTypes[FMath::FloorLog2(Domain) - 1];
+			OutPuzzleDef.Blocks.Add(BlockDef);
+		}
+	}
+
+	OutPuzzleDef.UpdateBlockGrid();
+}
+
+bool FPuzzleSolver::RestrictCell(int32 CellIndex, uint16 Domain)
+{
+	if (!CellDomains.IsValidIndex(CellIndex))
+	{
+		return false;
+	}
+
+	const uint16 OldDomain = CellDomains[CellIndex];
+	const uint16 NewDomain = OldDomain & Domain;
+	if (NewDomain == 0)
+	{
+		Result.State = EPuzzleSolverState::Contradiction;
+		return false;
+	}
+
+	if (NewDomain != OldDomain)
+	{
+		CellDomains[CellIndex] = NewDomain;
+		if (FMath::IsPowerOfTwo(NewDomain))
+		{
+			++Result.NumCellsFixed;
+			--NumUnknownCells;
+		}
+
+		const FIntVector Position(CellIndex / (Dimensions.Y * Dimensions.Z),
+		                          (CellIndex / Dimensions.Z) % Dimensions.Y,
+		                          CellIndex % Dimensions.Z);
+		QueueCrossingRows(Position, INDEX_NONE);
+
+		if (!Propagate())
+		{
+			Result.State = EPuzzleSolverState::Contradiction;
+			return false;
+		}
+	}
+
+	Result.State = NumUnknownCells == 0 ? EPuzzleSolverState::Solved : EPuzzleSolverState::Stuck;
+	return true;
+}
+
+void FPuzzleSolver::SetCellDomains(const TArray<uint16>& InCellDomains)
+{
+	check(InCellDomains.Num() == CellDomains.Num());
+
+	CellDomains = InCellDomains;
+
+	NumUnknownCells = 0;
+	for (const uint16 Domain : CellDomains)
+	{
+		NumUnknownCells += FMath::IsPowerOfTwo(Domain) ? 0 : 1;
+	}
+
+	Result.State = NumUnknownCells == 0 ? EPuzzleSolverState::Solved : EPuzzleSolverState::Stuck;
+}
+
+void FPuzzleSolver::QueueRow(int32 Axis, int32 AxisRowIndex)
+{
+	if (RowVisibility[Axis][AxisRowIndex] && !RowQueued[Axis][AxisRowIndex])
+	{
+		RowQueued[Axis][AxisRowIndex] = true;
+		RowQueue.Add(FPuzzleRow::MakeRowId(Axis, AxisRowIndex));
+	}
+}
+
+bool FPuzzleSolver::Propagate()
+{
+	bool bSuccess = true;
+	while (RowQueueHead < RowQueue.Num())
+	{
+		const int32 RowId = RowQueue[RowQueueHead++];
+		RowQueued[FPuzzleRow::GetRowIdAxis(RowId)][FPuzzleRow::GetRowIdAxisRowIndex(RowId)] = false;
+
+		if (!SolveRow(RowId))
+		{
+			bSuccess = false;
+			break;
+		}
+	}
+
+	// clear anything left over from a contradiction
+	for (; RowQueueHead < RowQueue.Num(); ++RowQueueHead)
+	{
+		const int32 RowId = RowQueue[RowQueueHead];
+		RowQueued[FPuzzleRow::GetRowIdAxis(RowId)][FPuzzleRow::GetRowIdAxisRowIndex(RowId)] = false;
+	}
+	RowQueue.Reset();
+	RowQueueHead = 0;
+
+	return bSuccess;
+}
+
+bool FPuzzleSolver::SolveRow(int32 RowId)
+{
+	const int32 Axis = FPuzzleRow::GetRowIdAxis(RowId);
+	const int32 AxisRowIndex = FPuzzleRow::GetRowIdAxisRowIndex(RowId);
+	const FRowTypeCount* Counts = &RowTypeCounts[Axis][AxisRowIndex * NumTypeSlots];
+
+	int32 StartIndex, Stride, Length;
+	GetRowCells(RowId, StartIndex, Stride, Length);
+
+	++Result.NumRowsEvaluated;
+
+	// the hardest rule that changed any cell
+	EPuzzleSolverRule Rule = EPuzzleSolverRule::ZeroRow;
+
+	// types with no blocks in this row can be removed from every cell
+	uint16 AbsentTypes = 0;
+	int32 NumFilled = 0;
+	for (int32 TypeIdx = 1; TypeIdx < NumTypeSlots; ++TypeIdx)
+	{
+		if (Counts[TypeIdx].NumBlocks == 0)
+		{
+			AbsentTypes |= 1 << TypeIdx;
+		}
+		NumFilled += Counts[TypeIdx].NumBlocks;
+	}
+
+	if (NumFilled > Length)
+	{
+		return false;
+	}
+
+	FPuzzleRowBitboard Bitboard(Length, NumTypeSlots);
+	for (int32 Idx = 0; Idx < Length; ++Idx)
+	{
+		const uint16 CellDomain = CellDomains[StartIndex + Idx * Stride];
+		Bitboard.SetCellDomain(Idx, CellDomain & ~AbsentTypes);
+		if (CellDomain & AbsentTypes)
+		{
+			Rule = EPuzzleSolverRule::AbsentTypes;
+		}
+	}
+
+	if (!Bitboard.IsConsistent())
+	{
+		return false;
+	}
+
+	// apply the total number of blocks and the counts for each type until the row stops changing.
+	// the simpler total is applied first, so that steps only need the placement rule when the total isn't enough.
+	const uint64 RowMask = Bitboard.GetRowMask();
+	bool bChanged = true;
+	while (bChanged)
+	{
+		bChanged = false;
+
+		// the total number of blocks determines how many cells are empty space
+		const uint64 MayBeFilled = Bitboard.GetMayBeFilledMask();
+		const uint64 MustBeFilled = Bitboard.GetMustBeFilledMask();
+		const int32 NumMayBeFilled = FPuzzleRowBitboard::CountBlocks(MayBeFilled);
+		const int32 NumMustBeFilled = FPuzzleRowBitboard::CountBlocks(MustBeFilled);
+		if (NumMayBeFilled < NumFilled || NumMustBeFilled > NumFilled)
+		{
+			return false;
+		}
+
+		if (NumMayBeFilled == NumFilled && NumMustBeFilled < NumFilled)
+		{
+			// every cell that could have a block must have one
+			Bitboard.TypeMasks[0] &= ~MayBeFilled;
+			bChanged = true;
+			Rule = FMath::Max(Rule, EPuzzleSolverRule::BlockCount);
+		}
+		else if (NumMustBeFilled == NumFilled && NumMayBeFilled > NumFilled)
+		{
+			// all blocks are accounted for, everything else is empty
+			for (int32 TypeIdx = 1; TypeIdx < NumTypeSlots; ++TypeIdx)
+			{
+				Bitboard.TypeMasks[TypeIdx] &= MustBeFilled;
+			}
+			if (!Bitboard.IsConsistent())
+			{
+				return false;
+			}
+			bChanged = true;
+			Rule = FMath::Max(Rule, EPuzzleSolverRule::BlockCount);
+		}
+
+		for (int32 TypeIdx = 1; TypeIdx < NumTypeSlots; ++TypeIdx)
+		{
+			if (Counts[TypeIdx].NumBlocks == 0)
+			{
+				continue;
+			}
+
+			uint64 CanBeType, CanBeOther;
+			if (!FPuzzleRowBitboard::IntersectPlacements(Bitboard.TypeMasks[TypeIdx], Bitboard.GetOtherMask(TypeIdx),
+			                                             Length, Counts[TypeIdx].NumBlocks, Counts[TypeIdx].NumGroups,
+			                                             CanBeType, CanBeOther, RowScratch))
+			{
+				return false;
+			}
+
+			// cells that are never the type lose it, cells that are always the type lose everything else
+			const uint64 NewTypeMask = Bitboard.TypeMasks[TypeIdx] & CanBeType;
+			const uint64 MustBeType = RowMask & ~CanBeOther;
+			for (int32 OtherTypeIdx = 0; OtherTypeIdx < NumTypeSlots; ++OtherTypeIdx)
+			{
+				const uint64 OldMask = Bitboard.TypeMasks[OtherTypeIdx];
+				const uint64 NewMask = OtherTypeIdx == TypeIdx ? NewTypeMask : OldMask & ~MustBeType;
+				if (NewMask != OldMask)
+				{
+					bChanged = true;
+					Rule = EPuzzleSolverRule::Placement;
+				}
+				Bitboard.TypeMasks[OtherTypeIdx] = NewMask;
+			}
+		}
+
+		if (!Bitboard.IsConsistent())
+		{
+			return false;
+		}
+	}
+
+	// store the new cell states, and queue the other rows of any changed cells
+	int32 NumFixed = 0;
+	FPuzzleRow Row = FPuzzleRow::FromRowId(RowId, Dimensions);
+	for (int32 Idx = 0; Idx < Length; ++Idx)
+	{
+		uint16& CellDomain = CellDomains[StartIndex + Idx * Stride];
+		const uint16 NewDomain = Bitboard.GetCellDomain(Idx);
+		if (CellDomain == NewDomain)
+		{
+			continue;
+		}
+
+		CellDomain = NewDomain;
+		if (FMath::IsPowerOfTwo(CellDomain))
+		{
+			++NumFixed;
+			--NumUnknownCells;
+		}
+
+		FIntVector Position = Row.Position;
+		Position[Axis] = Idx;
+		QueueCrossingRows(Position, Axis);
+	}
+
+	Result.NumCellsFixed += NumFixed;
+
+	if (NumFixed > 0 && bRecordSteps)
+	{
+		FPuzzleSolverStep& Step = Result.Steps.AddDefaulted_GetRef();
+		Step.Row = Row;
+		Step.NumCellsFixed = NumFixed;
+
+		// rows with no choices are easy no matter which rules were applied
+		Step.Rule = Rule;
+		if (NumFilled == 0)
+		{
+			Step.Rule = EPuzzleSolverRule::ZeroRow;
+		}
+		else if (NumFilled == Length)
+		{
+			Step.Rule = EPuzzleSolverRule::FullRow;
+		}
+
+		// rows can be seen without slicing as long as they touch any face of the puzzle
+		int32 AxisA, AxisB;
+		FPuzzleRow::GetOtherAxes(Axis, AxisA, AxisB);
+		Step.bIsInteriorRow = Row.Position[AxisA] > 0 && Row.Position[AxisA] < Dimensions[AxisA] - 1 &&
+			Row.Position[AxisB] > 0 && Row.Position[AxisB] < Dimensions[AxisB] - 1;
+	}
+
+	return true;
+}
+
+void FPuzzleSolver::GetRowCells(int32 RowId, int32& OutStartIndex, int32& OutStride, int32& OutLength) const
+{
+	const FPuzzleRow Row = FPuzzleRow::FromRowId(RowId, Dimensions);
+	OutStartIndex = (Row.Position.X * Dimensions.Y + Row.Position.Y) * Dimensions.Z + Row.Position.Z;
+	OutStride = Row.Axis == 0 ? Dimensions.Y * Dimensions.Z : Row.Axis == 1 ? Dimensions.Z : 1;
+	OutLength = Dimensions[Row.Axis];
+}
+
+void FPuzzleSolver::QueueCrossingRows(const FIntVector& Position, int32 ExcludedAxis)
+{
+	for (int32 Axis = 0; Axis <= 2; ++Axis)
+	{
+		if (Axis != ExcludedAxis)
+		{
+			QueueRow(Axis, FPuzzleRow(Position, Axis).GetAxisRowIndex(Dimensions));
+		}
+	}
+}
+
+
+FPuzzleUniquenessChecker::FPuzzleUniquenessChecker()
+	: MaxGuesses(20000),
+	  MaxSeconds(1.0),
+	  bIsCancelled(false),
+	  Uniqueness(EPuzzleUniqueness::Unknown),
+	  NumGuesses(0),
+	  EndTime(0.0)
+{
+}
+
+EPuzzleUniqueness FPuzzleUniquenessChecker::Check(const FPuzzleAnnotations& Annotations,
+                                                  const FPuzzleDef* ExpectedSolution)
+{
+	SCOPE_CYCLE_COUNTER(STAT_PicrossCheckUniqueness);
+
+	Uniqueness = EPuzzleUniqueness::Unknown;
+	AmbiguousCells.Reset();
+	NumGuesses = 0;
+	EndTime = FPlatformTime::Seconds() + MaxSeconds;
+	FirstSolution.Reset();
+
+	if (bIsCancelled || !Solver.Initialize(Annotations))
+	{
+		return Uniqueness;
+	}
+
+	Solver.SetRecordSteps(false);
+	Solver.SolvePuzzle();
+
+	if (Solver.GetResult().State == EPuzzleSolverState::Contradiction)
+	{
+		Uniqueness = EPuzzleUniqueness::Unsolvable;
+		return Uniqueness;
+	}
+
+	const TArray<uint16> DeducedDomains = Solver.GetCellDomains();
+
+	// use the expected solution if it satisfies every visible row, otherwise search for one
+	if (ExpectedSolution && GetExpectedCellDomains(*ExpectedSolution, FirstSolution))
+	{
+		Solver.SetCellDomains(FirstSolution);
+		if (!Solver.SolvePuzzle())
+		{
+			FirstSolution.Reset();
+		}
+	}
+
+	if (FirstSolution.Num() == 0 && !FindFirstSolution(DeducedDomains))
+	{
+		return Uniqueness;
+	}
+
+	// every other solution differs from the first at some first cell. for each cell in order, look for a
+	// solution where it differs, and if there is none the cell must match, which helps with the next cells.
+	TArray<uint16> MatchingDomains = DeducedDomains;
+	bool bHasRestarted = false;
+	for (int32 CellIdx = 0; CellIdx < MatchingDomains.Num(); ++CellIdx)
+	{
+		if (FMath::IsPowerOfTwo(MatchingDomains[CellIdx]))
+		{
+			continue;
+		}
+
+		if (ShouldStop())
+		{
+			return Uniqueness;
+		}
+
+		if (OnProgress)
+		{
+			OnProgress(static_cast<float>(CellIdx) / MatchingDomains.Num());
+		}
+
+		++NumGuesses;
+		Solver.SetCellDomains(MatchingDomains);
+		if (Solver.RestrictCell(CellIdx, MatchingDomains[CellIdx] & ~FirstSolution[CellIdx]) &&
+			SearchForSolution(FirstSolution))
+		{
+			// a second solution, report every cell where they differ
+			const FIntVector& Dimensions = Solver.GetDimensions();
+			const TArray<uint16>& SecondSolution = Solver.GetCellDomains();
+			for (int32 OtherCellIdx = 0; OtherCellIdx < FirstSolution.Num(); ++OtherCellIdx)
+			{
+				if (FirstSolution[OtherCellIdx] != SecondSolution[OtherCellIdx])
+				{
+					AmbiguousCells.Add(FIntVector(OtherCellIdx / (Dimensions.Y * Dimensions.Z),
+					                              (OtherCellIdx / Dimensions.Z) % Dimensions.Y,
+					                              OtherCellIdx % Dimensions.Z));
+				}
+			}
+
+			Uniqueness = EPuzzleUniqueness::Ambiguous;
+			return Uniqueness;
+		}
+
+		if (ShouldStop())
+		{
+			return Uniqueness;
+		}
+
+		Solver.SetCellDomains(MatchingDomains);
+		if (!Solver.RestrictCell(CellIdx, FirstSolution[CellIdx]))
+		{
+			// the first solution doesn't satisfy the annotations, which shouldn't happen once validated.
+			// search for a new one and start over, but only once, in case something else is wrong.
+			if (bHasRestarted || !FindFirstSolution(DeducedDomains))
+			{
+				return Uniqueness;
+			}
+			bHasRestarted = true;
+			MatchingDomains = DeducedDomains;
+			CellIdx = -1;
+			continue;
+		}
+		MatchingDomains = Solver.GetCellDomains();
+	}
+
+	Uniqueness = EPuzzleUniqueness::Unique;
+	return Uniqueness;
+}
+
+bool FPuzzleUniquenessChecker::FindFirstSolution(const TArray<uint16>& DeducedDomains)
+{
+	Solver.SetCellDomains(DeducedDomains);
+	if (!SearchForSolution(TArray<uint16>()))
+	{
+		if (!ShouldStop())
+		{
+			Uniqueness = EPuzzleUniqueness::Unsolvable;
+		}
+		return false;
+	}
+
+	FirstSolution = Solver.GetCellDomains();
+	return true;
+}
+
+bool FPuzzleUniquenessChecker::SearchForSolution(const TArray<uint16>& PreferredTypes)
+{
+	if (Solver.GetNumUnknownCells() == 0)
+	{
+		return true;
+	}
+
+	// depth first search, each guess remembers the cell types to restore before trying its next type
+	TArray<FGuess> Guesses;
+	FGuess& FirstGuess = Guesses.AddDefaulted_GetRef();
+	FirstGuess.CellDomains = Solver.GetCellDomains();
+	FirstGuess.CellIndex = FindGuessCell();
+	FirstGuess.UntriedTypes = FirstGuess.CellDomains[FirstGuess.CellIndex];
+
+	while (Guesses.Num() > 0)
+	{
+		if (ShouldStop())
+		{
+			UE_LOG(LogPicross, Verbose, TEXT("Uniqueness check stopped after %d guesses"), NumGuesses);
+			return false;
+		}
+
+		FGuess& Guess = Guesses.Last();
+		if (Guess.UntriedTypes == 0)
+		{
+			Guesses.Pop(false);
+			continue;
+		}
+
+		// try the preferred type first, then the remaining types in order
+		const uint16 PreferredType = PreferredTypes.Num() > 0 ? Guess.UntriedTypes & PreferredTypes[Guess.CellIndex] : 0;
+		const uint16 TypeBit = PreferredType ? PreferredType : Guess.UntriedTypes & (~Guess.UntriedTypes + 1);
+		Guess.UntriedTypes &= ~TypeBit;
+		++NumGuesses;
+
+		Solver.SetCellDomains(Guess.CellDomains);
+		if (!Solver.RestrictCell(Guess.CellIndex, TypeBit))
+		{
+			continue;
+		}
+
+		if (Solver.GetNumUnknownCells() == 0)
+		{
+			return true;
+		}
+
+		FGuess& NextGuess = Guesses.AddDefaulted_GetRef();
+		NextGuess.CellDomains = Solver.GetCellDomains();
+		NextGuess.CellIndex = FindGuessCell();
+		NextGuess.UntriedTypes = NextGuess.CellDomains[NextGuess.CellIndex];
+	}
+
+	return false;
+}
+
+bool FPuzzleUniquenessChecker::GetExpectedCellDomains(const FPuzzleDef& PuzzleDef, TArray<uint16>& OutCellDomains) const
+{
+	const int32 NumCells = Solver.GetCellDomains().Num();
+	if (PuzzleDef.Dimensions != Solver.GetDimensions() || !PuzzleDef.IsBlockGridValid() ||
+		PuzzleDef.GetNumCells() != NumCells)
+	{
+		return false;
+	}
+
+	OutCellDomains.SetNumUninitialized(NumCells);
+	for (int32 CellIdx = 0; CellIdx < NumCells; ++CellIdx)
+	{
+		const FGameplayTag BlockType = PuzzleDef.GetBlockTypeFromIndex(PuzzleDef.GetBlockTypeIndexAtCell(CellIdx));
+		const int32 TypeIdx = BlockType.IsValid() ? Solver.GetBlockTypes().IndexOfByKey(BlockType) + 1 : 0;
+		if (BlockType.IsValid() && TypeIdx == 0)
+		{
+			OutCellDomains.Reset();
+			return false;
+		}
+		OutCellDomains[CellIdx] = static_cast<uint16>(1 << TypeIdx);
+	}
+	return true;
+}
+
+bool FPuzzleUniquenessChecker::GetSolution(FPuzzleDef& OutPuzzleDef)
+{
+	if (FirstSolution.Num() == 0)
+	{
+		return false;
+	}
+
+	Solver.SetCellDomains(FirstSolution);
+	Solver.GetSolution(OutPuzzleDef);
+	return true;
+}
+
+int32 FPuzzleUniquenessChecker::FindGuessCell() const
+{
+	const TArray<uint16>& CellDomains = Solver.GetCellDomains();
+
+	int32 BestCellIdx = INDEX_NONE;
+	int32 BestNumTypes = MAX_int32;
+	for (int32 CellIdx = 0; CellIdx < CellDomains.Num(); ++CellIdx)
+	{
+		const int32 NumTypes = FMath::CountBits(CellDomains[CellIdx]);
+		if (NumTypes > 1 && NumTypes < BestNumTypes)
+		{
+			BestCellIdx = CellIdx;
+			BestNumTypes = NumTypes;
+			if (NumTypes == 2)
+			{
+				break;
+			}
+		}
+	}
+	return BestCellIdx;
+}
@@ -0,0 +1,365 @@
+﻿// Copyright Bohdon Sayre.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "PuzzleRowBitboard.h"
+#include "HAL/ThreadSafeBool.h"
+#include "PuzzleTypes.h"
+
+
+/**
+ * The state of a puzzle solve
+ */
+enum class EPuzzleSolverState : uint8
+{
+	/** The annotations did not provide enough information to deduce every cell */
+	Stuck,
+	/** Every cell has been deduced */
+	Solved,
+	/** The annotations contradict each other, the puzzle has no solution */
+	Contradiction,
+};
+
+
+/**
+ * The rules used to make a deduction from a row, from easiest to hardest
+ */
+enum class EPuzzleSolverRule : uint8
+{
+	/** The row has no blocks, every cell is empty space */
+	ZeroRow,
+	/** The row has no empty space, every cell is a block */
+	FullRow,
+	/** Block types that don't appear in the row were ruled out */
+	AbsentTypes,
+	/** The total number of blocks in the row determined which cells are filled or empty */
+	BlockCount,
+	/** Cells were covered, or never covered, by every possible placement of a type's groups */
+	Placement,
+};
+
+
+/**
+ * A single deduction made while solving a puzzle
+ */
+struct PICROSS_API FPuzzleSolverStep
+{
+	FPuzzleSolverStep()
+		: NumCellsFixed(0),
+		  Rule(EPuzzleSolverRule::ZeroRow),
+		  bIsInteriorRow(false)
+	{
+	}
+
+	/** The row that was used to make the deduction */
+	FPuzzleRow Row;
+
+	/** The number of cells whose type was fully determined by this step */
+	int32 NumCellsFixed;
+
+	/** The hardest rule needed to make the deduction */
+	EPuzzleSolverRule Rule;
+
+	/** Is the row inside the puzzle, so that the puzzle must be sliced to see it? */
+	bool bIsInteriorRow;
+};
+
+
+/**
+ * The results of solving a puzzle
+ */
+struct PICROSS_API FPuzzleSolverResult
+{
+	FPuzzleSolverResult()
+		: State(EPuzzleSolverState::Stuck),
+		  NumCellsFixed(0),
+		  NumRowsEvaluated(0)
+	{
+	}
+
+	/** The final state of the solve */
+	EPuzzleSolverState State;
+
+	/** The total number of cells whose type was determined */
+	int32 NumCellsFixed;
+
+	/** The number of times a row constraint was evaluated */
+	int32 NumRowsEvaluated;
+
+	/** Every deduction that fixed at least one cell, in order */
+	TArray<FPuzzleSolverStep> Steps;
+
+	FORCEINLINE bool IsSolved() const { return State == EPuzzleSolverState::Solved; }
+
+	/**
+	 * Return a rating of how hard the deductions were, from the steps of a solve.
+	 * Each fixed cell is weighted by the rule needed to fix it, and more if its row was inside the puzzle,
+	 * and the rating is the average weight, from 1 for only zero and full rows, up to 7.5.
+	 * Returns 0 if the puzzle was not solved, or no steps were recorded.
+	 */
+	float GetDifficulty() const;
+};
+
+
+/**
+ * Puzzle solver used to both solve puzzles and provide information
+ * needed to determine annotations based on puzzle difficulty.
+ *
+ * Each cell tracks the set of types it could still be (empty space, or any block type).
+ * Visible row annotations are applied along all three axes, removing types from cells
+ * that cannot be part of any arrangement of the row, until nothing else can be deduced.
+ */
+class PICROSS_API FPuzzleSolver
+{
+public:
+	/** The maximum number of cells in a single row */
+	static constexpr int32 MaxRowLength = FPuzzleRowBitboard::MaxCells;
+
+	/** The maximum number of block types in a puzzle, not including empty space */
+	static constexpr int32 MaxBlockTypes = FPuzzleRowBitboard::MaxTypes - 1;
+
+	FPuzzleSolver();
+
+	/**
+	 * Set the annotations to solve with, and reset all cells to unknown.
+	 * @return False if the puzzle is too large or uses too many block types to be solved.
+	 */
+	bool Initialize(const FPuzzleAnnotations& InAnnotations);
+
+	/**
+	 * Try to solve the whole puzzle with the current annotations.
+	 * @return True if the puzzle could be solved, false if the annotations did not provide enough information.
+	 */
+	bool SolvePuzzle();
+
+	/** Return the results of the last solve */
+	FORCEINLINE const FPuzzleSolverResult& GetResult() const { return Result; }
+
+	/** Return the dimensions of the puzzle being solved */
+	FORCEINLINE const FIntVector& GetDimensions() const { return Dimensions; }
+
+	/** Return the block types in the puzzle. Block type N is at index N - 1, type 0 is empty space. */
+	FORCEINLINE const TArray<FGameplayTag>& GetBlockTypes() const { return BlockTypes; }
+
+	/** Return the types a cell could still be, bit 0 for empty space, and bit N for block type N */
+	FORCEINLINE uint16 GetCellDomain(int32 CellIndex) const { return CellDomains[CellIndex]; }
+
+	/** Return true if the type of a cell has been determined */
+	FORCEINLINE bool IsCellKnown(int32 CellIndex) const { return FMath::IsPowerOfTwo(CellDomains[CellIndex]); }
+
+	/** Return the number of cells whose type has not been determined */
+	FORCEINLINE int32 GetNumUnknownCells() const { return NumUnknownCells; }
+
+	/** Build a puzzle definition from the known cells. Unknown cells are left empty. */
+	void GetSolution(FPuzzleDef& OutPuzzleDef) const;
+
+	/**
+	 * Restrict the types a cell could be, then apply the annotations until nothing else can be deduced.
+	 * @param CellIndex The cell to restrict
+	 * @param Domain The types the cell could be, bit 0 for empty space, and bit N for block type N
+	 * @return False if the restriction contradicts the annotations
+	 */
+	bool RestrictCell(int32 CellIndex, uint16 Domain);
+
+	/** Return the types every cell could still be, indexed by cell index */
+	FORCEINLINE const TArray<uint16>& GetCellDomains() const { return CellDomains; }
+
+	/** Restore the types every cell could be, e.g. from a previous call to GetCellDomains */
+	void SetCellDomains(const TArray<uint16>& InCellDomains);
+
+	/** Return true if the annotations of a row are used, see FPuzzleRow::MakeRowId */
+	FORCEINLINE bool IsRowVisible(int32 RowId) const
+	{
+		return RowVisibility[FPuzzleRow::GetRowIdAxis(RowId)][FPuzzleRow::GetRowIdAxisRowIndex(RowId)];
+	}
+
+	/**
+	 * Set whether the annotations of a row are used, without resetting any cells.
+	 * Only affects rows evaluated after this, e.g. by the next call to SolvePuzzle.
+	 */
+	FORCEINLINE void SetRowVisible(int32 RowId, bool bNewVisible)
+	{
+		RowVisibility[FPuzzleRow::GetRowIdAxis(RowId)][FPuzzleRow::GetRowIdAxisRowIndex(RowId)] = bNewVisible;
+	}
+
+	/** Set whether deductions are recorded as steps in the result. Disable when only the solution matters. */
+	FORCEINLINE void SetRecordSteps(bool bNewRecordSteps) { bRecordSteps = bNewRecordSteps; }
+
+protected:
+	/** The number of cells in a row of each type for a single row annotation */
+	struct FRowTypeCount
+	{
+		uint8 NumBlocks;
+		uint8 NumGroups;
+	};
+
+	/** The dimensions of the puzzle */
+	FIntVector Dimensions;
+
+	/** All block types in the puzzle */
+	TArray<FGameplayTag> BlockTypes;
+
+	/** The number of type slots, one for empty space plus one for each block type */
+	int32 NumTypeSlots;
+
+	/** The types each cell could still be, indexed by cell index */
+	TArray<uint16> CellDomains;
+
+	/** The number of cells that are not known yet */
+	int32 NumUnknownCells;
+
+	/** Whether the annotations for each row are visible, indexed by axis, then axis row index */
+	TArray<bool> RowVisibility[3];
+
+	/** The block counts for each row, indexed by axis, then by axis row index * NumTypeSlots + type index */
+	TArray<FRowTypeCount> RowTypeCounts[3];
+
+	/** Rows waiting to be evaluated, as packed row ids */
+	TArray<int32> RowQueue;
+
+	/** The index of the next row to evaluate in RowQueue */
+	int32 RowQueueHead;
+
+	/** Whether each row is currently in the queue, indexed by axis, then axis row index */
+	TArray<bool> RowQueued[3];
+
+	/** Scratch space for row evaluation */
+	TArray<uint64> RowScratch;
+
+	/** The results of the current solve */
+	FPuzzleSolverResult Result;
+
+	/** Whether deductions are recorded as steps in the result */
+	bool bRecordSteps;
+
+	/** Queue a row for evaluation if it has visible annotations */
+	void QueueRow(int32 Axis, int32 AxisRowIndex);
+
+	/** Evaluate queued rows until no more deductions can be made */
+	bool Propagate();
+
+	/**
+	 * Apply the annotations of a row to its cells.
+	 * @return False if the row cannot be satisfied.
+	 */
+	bool SolveRow(int32 RowId);
+
+	/** Return the first cell index, and the cell index stride between cells of a row */
+	void GetRowCells(int32 RowId, int32& OutStartIndex, int32& OutStride, int32& OutLength) const;
+
+	/** Queue the rows along the other axes that cross a cell */
+	void QueueCrossingRows(const FIntVector& Position, int32 ExcludedAxis);
+};
+
+
+/**
+ * Determines whether the annotations of a puzzle have exactly one solution.
+ *
+ * Annotations are applied until nothing else can be deduced, then a first solution is found by guessing
+ * the most constrained unknown cell and backtracking on contradictions. Each remaining unknown cell is then
+ * forced to differ from the first solution, searching for a second solution that agrees with the first
+ * everywhere else it can. If there is none, the cell must match the first solution, narrowing later searches.
+ * Check can run on any thread, and be cancelled from another thread.
+ */
+class PICROSS_API FPuzzleUniquenessChecker
+{
+public:
+	FPuzzleUniquenessChecker();
+
+	/** The maximum number of guesses to make before giving up with an unknown result */
+	int32 MaxGuesses;
+
+	/** The maximum time to spend on a check before giving up with an unknown result, in seconds */
+	double MaxSeconds;
+
+	/** Called on the checking thread as cells are verified, with the fraction of cells verified so far */
+	TFunction<void(float /* Progress */)> OnProgress;
+
+	/**
+	 * Check whether annotations have exactly one solution.
+	 * @param Annotations The annotations to check
+	 * @param ExpectedSolution The puzzle the annotations were generated from, if known, to skip finding a first solution.
+	 *		It is validated against the annotations, and a first solution is searched for if it doesn't satisfy them.
+	 */
+	EPuzzleUniqueness Check(const FPuzzleAnnotations& Annotations, const FPuzzleDef* ExpectedSolution = nullptr);
+
+	/** Stop the current or next check as soon as possible, the result will be unknown. Thread safe. */
+	FORCEINLINE void Cancel() { bIsCancelled = true; }
+
+	/** Return true if the check has been cancelled */
+	FORCEINLINE bool IsCancelled() const { return bIsCancelled; }
+
+	/** Return the result of the last check */
+	FORCEINLINE EPuzzleUniqueness GetUniqueness() const { return Uniqueness; }
+
+	/** Return the cells that differ between two solutions, if the annotations are ambiguous */
+	FORCEINLINE const TArray<FIntVector>& GetAmbiguousCells() const { return AmbiguousCells; }
+
+	/** Return the number of guesses made during the last check */
+	FORCEINLINE int32 GetNumGuesses() const { return NumGuesses; }
+
+	/** Build a puzzle definition from the first solution found. Returns false if no solution was found. */
+	bool GetSolution(FPuzzleDef& OutPuzzleDef);
+
+protected:
+	/** A cell that was guessed, and the types that haven't been tried yet */
+	struct FGuess
+	{
+		/** The cell types before the guess */
+		TArray<uint16> CellDomains;
+
+		/** The cell being guessed */
+		int32 CellIndex;
+
+		/** The types that haven't been tried for the cell yet */
+		uint16 UntriedTypes;
+	};
+
+	/** The solver used to apply annotations */
+	FPuzzleSolver Solver;
+
+	/** Set when the check should stop */
+	FThreadSafeBool bIsCancelled;
+
+	/** The result of the last check */
+	EPuzzleUniqueness Uniqueness;
+
+	/** The cells that differ between two solutions */
+	TArray<FIntVector> AmbiguousCells;
+
+	/** The number of guesses made during the last check */
+	int32 NumGuesses;
+
+	/** The platform time at which the current check gives up */
+	double EndTime;
+
+	/** The cell types of the first solution found, empty if none was found */
+	TArray<uint16> FirstSolution;
+
+	/** Return true if the check was cancelled, has made too many guesses, or is out of time */
+	FORCEINLINE bool ShouldStop() const
+	{
+		return bIsCancelled || NumGuesses >= MaxGuesses || FPlatformTime::Seconds() >= EndTime;
+	}
+
+	/**
+	 * Search for a first solution from the cells deduced from the annotations, storing it in FirstSolution.
+	 * @return False if there is no solution, setting the result to unsolvable, or the search stopped
+	 */
+	bool FindFirstSolution(const TArray<uint16>& DeducedDomains);
+
+	/**
+	 * Search for a solution from the current solver state, leaving the solver at the solution if one is found.
+	 * @param PreferredTypes The type to try first for each cell, or empty to try types in order
+	 * @return False if there is no solution, or the search stopped
+	 */
+	bool SearchForSolution(const TArray<uint16>& PreferredTypes);
+
+	/** Convert a puzzle into the solver's cell types. Returns false if it doesn't match the annotations. */
+	bool GetExpectedCellDomains(const FPuzzleDef& PuzzleDef, TArray<uint16>& OutCellDomains) const;
+
+	/** Return the unknown cell with the fewest possible types, or INDEX_NONE if every cell is known */
+	int32 FindGuessCell() const;
+};
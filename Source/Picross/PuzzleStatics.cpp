@@ -3,8 +3,96 @@
 
 #include "PuzzleStatics.h"
 
+#include "PuzzleAnnotationMinimizer.h"
+#include "PuzzleGenerator.h"
+#include "PuzzleSolver.h"
+#include "Async/ParallelFor.h"
+
 
 bool UPuzzleStatics::IsZeroAnnotation(const FPuzzleRowAnnotations& RowAnnotations)
 {
 	return RowAnnotations.IsZeroAnnotation();
 }
+
+bool UPuzzleStatics::IsPuzzleSolvable(const FPuzzleDef& PuzzleDef)
+{
+	FPuzzleAnnotations Annotations;
+	GenerateAnnotationsWithBlockGrid(PuzzleDef, Annotations);
+
+	FPuzzleSolver Solver;
+	return Solver.Initialize(Annotations) && Solver.SolvePuzzle();
+}
+
+bool UPuzzleStatics::GenerateMinimalAnnotations(const FPuzzleDef& PuzzleDef, float Difficulty,
+                                                FPuzzleAnnotations& OutAnnotations)
+{
+	FPuzzleAnnotations Annotations;
+	GenerateAnnotationsWithBlockGrid(PuzzleDef, Annotations);
+
+	FPuzzleAnnotationMinimizer Minimizer;
+	Minimizer.Difficulty = Difficulty;
+	Minimizer.Seed = PuzzleDef.AnnotationSeed;
+	return Minimizer.Minimize(Annotations, OutAnnotations);
+}
+
+float UPuzzleStatics::GetPuzzleDifficulty(const FPuzzleDef& PuzzleDef)
+{
+	FPuzzleAnnotations Annotations;
+	GenerateAnnotationsWithBlockGrid(PuzzleDef, Annotations);
+	return GetAnnotatedPuzzleDifficulty(Annotations);
+}
+
+float UPuzzleStatics::GetAnnotatedPuzzleDifficulty(const FPuzzleAnnotations& Annotations)
+{
+	FPuzzleSolver Solver;
+	if (!Solver.Initialize(Annotations))
+	{
+		return 0.f;
+	}
+
+	Solver.SolvePuzzle();
+	return Solver.GetResult().GetDifficulty();
+}
+
+TArray<float> UPuzzleStatics::GetPuzzleDifficulties(const TArray<FPuzzleDef>& PuzzleDefs)
+{
+	TArray<float> Difficulties;
+	Difficulties.SetNumZeroed(PuzzleDefs.Num());
+
+	ParallelFor(PuzzleDefs.Num(), [&PuzzleDefs, &Difficulties](int32 Idx)
+	{
+		Difficulties[Idx] = GetPuzzleDifficulty(PuzzleDefs[Idx]);
+	});
+
+	return Difficulties;
+}
+
+void UPuzzleStatics::GenerateAnnotationsWithBlockGrid(const FPuzzleDef& PuzzleDef, FPuzzleAnnotations& OutAnnotations)
+{
+	FPuzzleDef PuzzleDefWithGrid = PuzzleDef;
+	PuzzleDefWithGrid.UpdateBlockGrid();
+	FPuzzleAnnotations::GenerateAnnotations(PuzzleDefWithGrid, OutAnnotations);
+}
+
+bool UPuzzleStatics::GeneratePuzzle(FIntVector Dimensions, const TArray<FGameplayTag>& BlockTypes, float Density,
+                                    int32 Seed, FPuzzleDef& OutPuzzleDef)
+{
+	FPuzzleGenerator Generator;
+	Generator.Dimensions = Dimensions;
+	Generator.BlockTypes = BlockTypes;
+	Generator.Density = Density;
+	return Generator.Generate(Seed, OutPuzzleDef);
+}
+
+TArray<FPuzzleDef> UPuzzleStatics::GeneratePuzzles(FIntVector Dimensions, const TArray<FGameplayTag>& BlockTypes,
+                                                   float Density, int32 Seed, int32 NumPuzzles)
+{
+	FPuzzleGenerator Generator;
+	Generator.Dimensions = Dimensions;
+	Generator.BlockTypes = BlockTypes;
+	Generator.Density = Density;
+
+	TArray<FPuzzleDef> PuzzleDefs;
+	Generator.GenerateMany(Seed, NumPuzzles, PuzzleDefs);
+	return PuzzleDefs;
+}
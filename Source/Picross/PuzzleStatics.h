@@ -22,4 +22,55 @@ public:
 	/** Return true if a row annotation represents a 0 row */
 	UFUNCTION(BlueprintCallable)
 	static bool IsZeroAnnotation(const FPuzzleRowAnnotations& RowAnnotations);
+
+	/** Return true if a puzzle can be fully solved using only the annotations generated for it */
+	UFUNCTION(BlueprintCallable)
+	static bool IsPuzzleSolvable(const FPuzzleDef& PuzzleDef);
+
+	/**
+	 * Generate annotations for a puzzle, hiding as many rows as possible while keeping it solvable by deduction.
+	 * Rows are tried in an order decided by the puzzle's annotation seed.
+	 * @param Difficulty The fraction of all rows to try to hide, 1 hides as many rows as possible
+	 * @return False if the puzzle can't be solved by deduction even with every row visible
+	 */
+	UFUNCTION(BlueprintCallable)
+	static bool GenerateMinimalAnnotations(const FPuzzleDef& PuzzleDef, float Difficulty,
+	                                       FPuzzleAnnotations& OutAnnotations);
+
+	/**
+	 * Return a rating of how hard a puzzle is to solve with the annotations generated for it,
+	 * from 1 for puzzles made only of zero and full rows, up to 7.5. Returns 0 if it can't be solved by deduction.
+	 */
+	UFUNCTION(BlueprintCallable)
+	static float GetPuzzleDifficulty(const FPuzzleDef& PuzzleDef);
+
+	/** Return a rating of how hard a puzzle is to solve with a set of annotations, see GetPuzzleDifficulty */
+	UFUNCTION(BlueprintCallable)
+	static float GetAnnotatedPuzzleDifficulty(const FPuzzleAnnotations& Annotations);
+
+	/** Return the difficulty rating of many puzzles, rated in parallel, see GetPuzzleDifficulty */
+	UFUNCTION(BlueprintCallable)
+	static TArray<float> GetPuzzleDifficulties(const TArray<FPuzzleDef>& PuzzleDefs);
+
+	/**
+	 * Generate a random puzzle that can be fully solved by deduction, and so has exactly one solution.
+	 * The same seed and settings always generate the same puzzle.
+	 * @param Dimensions The dimensions of the puzzle
+	 * @param BlockTypes The block types to fill cells with
+	 * @param Density The fraction of cells to fill with blocks
+	 * @param Seed The seed for the puzzle
+	 * @return False if no solvable puzzle could be generated
+	 */
+	UFUNCTION(BlueprintCallable)
+	static bool GeneratePuzzle(FIntVector Dimensions, const TArray<FGameplayTag>& BlockTypes, float Density,
+	                           int32 Seed, FPuzzleDef& OutPuzzleDef);
+
+	/** Generate many random puzzles in parallel, see GeneratePuzzle. Puzzles that could not be generated are left out. */
+	UFUNCTION(BlueprintCallable)
+	static TArray<FPuzzleDef> GeneratePuzzles(FIntVector Dimensions, const TArray<FGameplayTag>& BlockTypes,
+	                                          float Density, int32 Seed, int32 NumPuzzles);
+
+private:
+	/** Generate annotations for a puzzle from Blueprints, rebuilding its block grid in case blocks were edited in place */
+	static void GenerateAnnotationsWithBlockGrid(const FPuzzleDef& PuzzleDef, FPuzzleAnnotations& OutAnnotations);
 };
@@ -3,7 +3,13 @@
 
 #include "PuzzleTypes.h"
 
+#include "Picross.h"
 #include "PicrossGameSettings.h"
+#include "PuzzleRowBitboard.h"
+#include "Async/ParallelFor.h"
+
+
+DECLARE_CYCLE_STAT(TEXT("Generate Annotations"), STAT_PicrossGenerateAnnotations, STATGROUP_Picross);
 
 
 FString FPuzzleRow::ToString() const
@@ -11,13 +17,90 @@ FString FPuzzleRow::ToString() const
 	return FString::Printf(TEXT("%s-%d"), *Position.ToString(), Axis);
 }
 
+FPuzzleRow FPuzzleRow::FromRowId(int32 RowId, const FIntVector& Dimensions)
+{
+	const int32 RowAxis = GetRowIdAxis(RowId);
+	const int32 RowIndex = GetRowIdAxisRowIndex(RowId);
+
+	int32 AxisA, AxisB;
+	GetOtherAxes(RowAxis, AxisA, AxisB);
+
+	FIntVector RowPosition(0, 0, 0);
+	RowPosition[AxisA] = RowIndex / Dimensions[AxisB];
+	RowPosition[AxisB] = RowIndex % Dimensions[AxisB];
+	return FPuzzleRow(RowPosition, RowAxis);
+}
+
 FString FPuzzleBlockDef::ToString() const
 {
 	return FString::Printf(TEXT("Block(%s, %s)"), *Position.ToString(), *Type.ToString());
 }
 
+void FPuzzleDef::UpdateBlockGrid()
+{
+	const int32 NumCells = FMath::Max(GetNumCells(), 0);
+
+	BlockTypes.Reset();
+	BlockTypeGrid.Reset(NumCells);
+	BlockTypeGrid.AddZeroed(NumCells);
+	BlockIndexGrid.Reset(NumCells);
+	BlockIndexGrid.Init(INDEX_NONE, NumCells);
+
+	for (int32 Idx = 0; Idx < Blocks.Num(); ++Idx)
+	{
+		const FPuzzleBlockDef& BlockDef = Blocks[Idx];
+		if (!BlockDef.IsValid() || !IsValidPosition(BlockDef.Position))
+		{
+			continue;
+		}
+
+		// first block def at a position wins, matching the linear search
+		const int32 CellIndex = GetCellIndex(BlockDef.Position);
+		if (BlockIndexGrid[CellIndex] != INDEX_NONE)
+		{
+			continue;
+		}
+
+		int32 TypeIdx = BlockTypes.IndexOfByKey(BlockDef.Type);
+		if (TypeIdx == INDEX_NONE)
+		{
+			if (!ensureMsgf(BlockTypes.Num() < MAX_uint8, TEXT("Too many block types in puzzle")))
+			{
+				continue;
+			}
+			TypeIdx = BlockTypes.Add(BlockDef.Type);
+		}
+
+		BlockTypeGrid[CellIndex] = static_cast<uint8>(TypeIdx + 1);
+		BlockIndexGrid[CellIndex] = Idx;
+	}
+
+	BlockGridDimensions = Dimensions;
+	BlockGridNumBlocks = Blocks.Num();
+}
+
+FIntVector FPuzzleDef::GetCellPosition(int32 CellIndex) const
+{
+	const int32 Z = CellIndex % Dimensions.Z;
+	const int32 Y = (CellIndex / Dimensions.Z) % Dimensions.Y;
+	const int32 X = CellIndex / (Dimensions.Z * Dimensions.Y);
+	return FIntVector(X, Y, Z);
+}
+
+uint8 FPuzzleDef::FindBlockTypeIndex(FGameplayTag Type) const
+{
+	const int32 TypeIdx = BlockTypes.IndexOfByKey(Type);
+	return TypeIdx != INDEX_NONE ? static_cast<uint8>(TypeIdx + 1) : 0;
+}
+
 int32 FPuzzleDef::GetBlockIndexAtPosition(FIntVector Position) const
 {
+	if (IsValidPosition(Position) && IsBlockGridValid())
+	{
+		return BlockIndexGrid[GetCellIndex(Position)];
+	}
+
+	// no grid available, or the block is outside the current dimensions
 	for (int32 Idx = 0; Idx < Blocks.Num(); ++Idx)
 	{
 		if (Blocks[Idx].Position == Position)
@@ -30,15 +113,118 @@ int32 FPuzzleDef::GetBlockIndexAtPosition(FIntVector Position) const
 
 FPuzzleBlockDef FPuzzleDef::GetBlockAtPosition(FIntVector Position) const
 {
-	// slow, but works for now
-	for (int32 Idx = 0; Idx < Blocks.Num(); ++Idx)
+	const int32 Idx = GetBlockIndexAtPosition(Position);
+	return Idx != INDEX_NONE ? Blocks[Idx] : FPuzzleBlockDef();
+}
+
+bool FPuzzleDef::SetBlockType(const FIntVector& Position, FGameplayTag NewType)
+{
+	if (!IsValidPosition(Position))
 	{
-		if (Blocks[Idx].Position == Position)
+		// blocks outside the dimensions aren't in the block grid, edit them directly and rebuild
+		const int32 BlockIdx = GetBlockIndexAtPosition(Position);
+		if (BlockIdx == INDEX_NONE)
+		{
+			if (!NewType.IsValid())
+			{
+				return false;
+			}
+			FPuzzleBlockDef NewBlockDef;
+			NewBlockDef.Position = Position;
+			NewBlockDef.Type = NewType;
+			Blocks.Add(NewBlockDef);
+		}
+		else if (!NewType.IsValid())
+		{
+			Blocks.RemoveAt(BlockIdx);
+		}
+		else if (Blocks[BlockIdx].Type != NewType)
+		{
+			Blocks[BlockIdx].Type = NewType;
+		}
+		else
+		{
+			return false;
+		}
+
+		UpdateBlockGrid();
+		return true;
+	}
+
+	if (!IsBlockGridValid())
+	{
+		UpdateBlockGrid();
+	}
+
+	const int32 CellIndex = GetCellIndex(Position);
+	const int32 BlockIdx = BlockIndexGrid[CellIndex];
+	if (BlockIdx == INDEX_NONE)
+	{
+		if (!NewType.IsValid())
 		{
-			return Blocks[Idx];
+			return false;
 		}
+
+		FPuzzleBlockDef NewBlockDef;
+		NewBlockDef.Position = Position;
+		NewBlockDef.Type = NewType;
+		BlockIndexGrid[CellIndex] = Blocks.Add(NewBlockDef);
+	}
+	else if (!NewType.IsValid())
+	{
+		// swap the last block into the removed slot, and update its index
+		const int32 LastIdx = Blocks.Num() - 1;
+		if (BlockIdx != LastIdx && IsValidPosition(Blocks[LastIdx].Position))
+		{
+			int32& LastBlockIdx = BlockIndexGrid[GetCellIndex(Blocks[LastIdx].Position)];
+			if (LastBlockIdx == LastIdx)
+			{
+				LastBlockIdx = BlockIdx;
+			}
+		}
+		Blocks.RemoveAtSwap(BlockIdx);
+		BlockIndexGrid[CellIndex] = INDEX_NONE;
+		BlockTypeGrid[CellIndex] = 0;
+		BlockGridNumBlocks = Blocks.Num();
+		return true;
+	}
+	else if (Blocks[BlockIdx].Type == NewType)
+	{
+		return false;
+	}
+	else
+	{
+		Blocks[BlockIdx].Type = NewType;
+	}
+
+	// types that are no longer used stay in BlockTypes until the grid is rebuilt
+	int32 TypeIdx = BlockTypes.IndexOfByKey(NewType);
+	if (TypeIdx == INDEX_NONE)
+	{
+		if (!ensureMsgf(BlockTypes.Num() < MAX_uint8, TEXT("Too many block types in puzzle")))
+		{
+			UpdateBlockGrid();
+			return true;
+		}
+		TypeIdx = BlockTypes.Add(NewType);
 	}
-	return FPuzzleBlockDef();
+
+	BlockTypeGrid[CellIndex] = static_cast<uint8>(TypeIdx + 1);
+	BlockGridNumBlocks = Blocks.Num();
+	return true;
+}
+
+const FPuzzleRowAnnotations* FPuzzleAnnotations::FindRowAnnotations(FPuzzleRow Row) const
+{
+	Row.Normalize();
+	if (!Row.IsWithinDimensions(Dimensions))
+	{
+		return nullptr;
+	}
+
+	const TArray<FPuzzleRowAnnotations>& AxisAnnotations = GetAxisRowAnnotations(Row.Axis);
+	const int32 RowIndex = Row.GetAxisRowIndex(Dimensions);
+	return AxisAnnotations.IsValidIndex(RowIndex) ? &AxisAnnotations[RowIndex] : nullptr;
 }
 
 void FPuzzleAnnotations::GetBlockAnnotations(FIntVector Position, FPuzzleBlockAnnotations& OutBlockAnnotations) const
@@ -50,108 +236,109 @@ void FPuzzleAnnotations::GetBlockAnnotations(FIntVector Position, FPuzzleBlockAn
 
 void FPuzzleAnnotations::GetRowAnnotations(FPuzzleRow Row, FPuzzleRowAnnotations& OutRowAnnotations) const
 {
-	Row.Normalize();
-	OutRowAnnotations = RowAnnotations.FindRef(Row.ToString());
+	const FPuzzleRowAnnotations* RowAnnotations = FindRowAnnotations(Row);
+	OutRowAnnotations = RowAnnotations ? *RowAnnotations : FPuzzleRowAnnotations();
 }
 
 void FPuzzleAnnotations::GenerateAnnotations(const FPuzzleDef& PuzzleDef, FPuzzleAnnotations& OutAnnotations)
 {
-	OutAnnotations.RowAnnotations.Empty(PuzzleDef.Dimensions.Y * PuzzleDef.Dimensions.Z);
-
-	// x-axis
-	for (int32 Y = 0; Y < PuzzleDef.Dimensions.Y; ++Y)
+	if (!PuzzleDef.IsBlockGridValid())
 	{
-		for (int32 Z = 0; Z < PuzzleDef.Dimensions.Z; ++Z)
-		{
-			const FPuzzleRow Row(FIntVector(0, Y, Z), 0);
-			FPuzzleRowAnnotations NewRowAnnotations = GenerateRowAnnotation(PuzzleDef, Row);
-			OutAnnotations.RowAnnotations.Add(Row.ToString(), NewRowAnnotations);
-		}
+		// build a block grid once up front, instead of searching blocks for every cell
+		FPuzzleDef PuzzleDefWithGrid = PuzzleDef;
+		PuzzleDefWithGrid.UpdateBlockGrid();
+		GenerateAnnotations(PuzzleDefWithGrid, OutAnnotations);
+		return;
 	}
 
-	// y-axis
-	for (int32 X = 0; X < PuzzleDef.Dimensions.X; ++X)
+	SCOPE_CYCLE_COUNTER(STAT_PicrossGenerateAnnotations);
+
+	OutAnnotations.Dimensions = PuzzleDef.Dimensions;
+
+	// allocate every row up front, so rows can be written from any thread without resizing
+	int32 AxisRowOffsets[4] = {0};
+	for (int32 Axis = 0; Axis <= 2; ++Axis)
 	{
-		for (int32 Z = 0; Z < PuzzleDef.Dimensions.Z; ++Z)
-		{
-			const FPuzzleRow Row(FIntVector(X, 0, Z), 1);
-			FPuzzleRowAnnotations NewRowAnnotations = GenerateRowAnnotation(PuzzleDef, Row);
-			OutAnnotations.RowAnnotations.Add(Row.ToString(), NewRowAnnotations);
-		}
+		const int32 NumRows = FPuzzleRow::GetNumRowsForAxis(Axis, PuzzleDef.Dimensions);
+		TArray<FPuzzleRowAnnotations>& AxisAnnotations = OutAnnotations.GetAxisRowAnnotations(Axis);
+		AxisAnnotations.Reset(NumRows);
+		AxisAnnotations.SetNum(NumRows);
+		AxisRowOffsets[Axis + 1] = AxisRowOffsets[Axis] + NumRows;
 	}
 
-	// z-axis
-	for (int32 X = 0; X < PuzzleDef.Dimensions.X; ++X)
+	// every row is independent, generate all rows of all axes in parallel
+	ParallelFor(AxisRowOffsets[3], [&PuzzleDef, &OutAnnotations, &AxisRowOffsets](int32 Index)
 	{
-		for (int32 Y = 0; Y < PuzzleDef.Dimensions.Y; ++Y)
-		{
-			const FPuzzleRow Row(FIntVector(X, Y, 0), 2);
-			FPuzzleRowAnnotations NewRowAnnotations = GenerateRowAnnotation(PuzzleDef, Row);
-			OutAnnotations.RowAnnotations.Add(Row.ToString(), NewRowAnnotations);
-		}
-	}
+		const int32 Axis = Index < AxisRowOffsets[1] ? 0 : Index < AxisRowOffsets[2] ? 1 : 2;
+		const int32 RowIndex = Index - AxisRowOffsets[Axis];
+		const FPuzzleRow Row = FPuzzleRow::FromRowId(FPuzzleRow::MakeRowId(Axis, RowIndex), PuzzleDef.Dimensions);
+		OutAnnotations.GetAxisRowAnnotations(Axis)[RowIndex] = GenerateRowAnnotation(PuzzleDef, Row);
+	});
 }
 
 FPuzzleRowAnnotations FPuzzleAnnotations::GenerateRowAnnotation(const FPuzzleDef& InPuzzle, FPuzzleRow Row)
 {
-	// block type for empty spaces
-	const FGameplayTag EmptyType = GetDefault<UPicrossGameSettings>()->BlockEmptyTag;
+	if (!InPuzzle.IsBlockGridValid())
+	{
+		FPuzzleDef PuzzleWithGrid = InPuzzle;
+		PuzzleWithGrid.UpdateBlockGrid();
+		return GenerateRowAnnotation(PuzzleWithGrid, Row);
+	}
 
 	FPuzzleRowAnnotations Result;
-	// row-type annotations, indexed by type for faster lookup when being built out
-	TMap<FGameplayTag, FPuzzleRowTypeAnnotation> TypeAnnotations;
 
 	Row.Normalize();
-	FIntVector CurrentPos = Row.Position;
-
-	// iterate through this row of blocks along the given axis,
-	// keep track of the last discovered block type to build group counts
-	FGameplayTag LastType;
 	const int32 Dimension = InPuzzle.Dimensions[Row.Axis];
-	for (int32 Idx = 0; Idx < Dimension; ++Idx)
+	if (!ensureMsgf(Dimension <= FPuzzleRowBitboard::MaxCells, TEXT("Puzzle rows cannot be longer than %d"),
+	                FPuzzleRowBitboard::MaxCells))
 	{
-		CurrentPos[Row.Axis] = Idx;
-
-		const FPuzzleBlockDef& BlockDef = InPuzzle.GetBlockAtPosition(CurrentPos);
-		if (BlockDef.IsValid())
-		{
-			// start a new row-type-annotation for this block type
-			if (!TypeAnnotations.Contains(BlockDef.Type))
-			{
-				FPuzzleRowTypeAnnotation NewTypeAnnotation;
-				NewTypeAnnotation.Type = BlockDef.Type;
-				// assume all are identified, until proven false
-				NewTypeAnnotation.bAreIdentified = true;
-				TypeAnnotations.Add(BlockDef.Type, NewTypeAnnotation);
-			}
-
-			FPuzzleRowTypeAnnotation& TypeAnnotation = TypeAnnotations[BlockDef.Type];
+		return Result;
+	}
 
-			// increase number of found blocks
-			++TypeAnnotation.NumBlocks;
+	// gather a mask of the cells of each block type in this row
+	TArray<uint64, TInlineAllocator<8>> TypeMasks;
+	TypeMasks.AddZeroed(InPuzzle.GetBlockTypes().Num() + 1);
 
-			// increment group count if last block type was different
-			if (LastType != BlockDef.Type)
-			{
-				++TypeAnnotation.NumGroups;
-			}
+	const int32 StartIndex = InPuzzle.GetCellIndex(Row.Position);
+	const int32 Stride = InPuzzle.GetCellStride(Row.Axis);
+	for (int32 Idx = 0; Idx < Dimension; ++Idx)
+	{
+		TypeMasks[InPuzzle.GetBlockTypeIndexAtCell(StartIndex + Idx * Stride)] |= 1ull << Idx;
+	}
 
-			LastType = BlockDef.Type;
-		}
-		else
+	// add a row-type-annotation for each block type in the row, ordered by where the type first appears
+	TArray<uint8, TInlineAllocator<8>> RowTypeIndices;
+	for (int32 TypeIdx = 1; TypeIdx < TypeMasks.Num(); ++TypeIdx)
+	{
+		if (TypeMasks[TypeIdx] != 0)
 		{
-			// no block at this position
-			LastType = EmptyType;
+			RowTypeIndices.Add(static_cast<uint8>(TypeIdx));
 		}
 	}
+	RowTypeIndices.Sort([&TypeMasks](uint8 A, uint8 B)
+	{
+		return FMath::CountTrailingZeros64(TypeMasks[A]) < FMath::CountTrailingZeros64(TypeMasks[B]);
+	});
 
-	// store type annotations on the full annotation
-	TypeAnnotations.GenerateValueArray(Result.TypeAnnotations);
+	for (const uint8 TypeIdx : RowTypeIndices)
+	{
+		FPuzzleRowTypeAnnotation& TypeAnnotation = Result.TypeAnnotations.AddDefaulted_GetRef();
+		TypeAnnotation.Type = InPuzzle.GetBlockTypeFromIndex(TypeIdx);
+		TypeAnnotation.NumBlocks = FPuzzleRowBitboard::CountBlocks(TypeMasks[TypeIdx]);
+		TypeAnnotation.NumGroups = FPuzzleRowBitboard::CountGroups(TypeMasks[TypeIdx]);
+		// assume all are identified, until proven false
+		TypeAnnotation.bAreIdentified = true;
+	}
 
 	if (Result.IsZeroAnnotation())
 	{
-		Result.bIsVisible = FMath::RandBool();
+		Result.bIsVisible = IsZeroRowVisible(InPuzzle.AnnotationSeed, Row.GetRowId(InPuzzle.Dimensions));
 	}
 
 	return Result;
 }
+
+bool FPuzzleAnnotations::IsZeroRowVisible(int32 Seed, int32 RowId)
+{
+	return (HashCombine(GetTypeHash(Seed), GetTypeHash(RowId)) & 1) != 0;
+}
@@ -24,6 +24,23 @@ enum class EPuzzleBlockState : uint8
 };
 
 
+/**
+ * Whether the annotations of a puzzle lead to exactly one solution
+ */
+UENUM(BlueprintType)
+enum class EPuzzleUniqueness : uint8
+{
+	/** Not checked yet, or the check was cancelled or gave up before finishing */
+	Unknown,
+	/** The annotations have exactly one solution */
+	Unique,
+	/** The annotations have more than one solution */
+	Ambiguous,
+	/** The annotations have no solution */
+	Unsolvable,
+};
+
+
 /**
  * A single row within a puzzle, represented by a position and axis
  */
@@ -62,6 +79,66 @@ public:
 
 	FORCEINLINE bool IsValid() const { return Axis >= 0 && Axis <= 2; }
 
+	/** Return the two axes perpendicular to a row axis, in ascending order */
+	static FORCEINLINE void GetOtherAxes(int32 InAxis, int32& OutAxisA, int32& OutAxisB)
+	{
+		OutAxisA = InAxis == 0 ? 1 : 0;
+		OutAxisB = InAxis == 2 ? 1 : 2;
+	}
+
+	/** Return the number of rows along an axis for a puzzle of the given dimensions */
+	static FORCEINLINE int32 GetNumRowsForAxis(int32 InAxis, const FIntVector& Dimensions)
+	{
+		int32 AxisA, AxisB;
+		GetOtherAxes(InAxis, AxisA, AxisB);
+		return Dimensions[AxisA] * Dimensions[AxisB];
+	}
+
+	/**
+	 * Return the index of this row among all rows along the same axis,
+	 * for a puzzle of the given dimensions. The row must be valid.
+	 */
+	FORCEINLINE int32 GetAxisRowIndex(const FIntVector& Dimensions) const
+	{
+		int32 AxisA, AxisB;
+		GetOtherAxes(Axis, AxisA, AxisB);
+		return Position[AxisA] * Dimensions[AxisB] + Position[AxisB];
+	}
+
+	/**
+	 * Return a packed integer id for this row, unique within a puzzle of the given dimensions.
+	 * The axis is stored in the low 2 bits, and the axis row index in the remaining bits.
+	 */
+	FORCEINLINE int32 GetRowId(const FIntVector& Dimensions) const
+	{
+		return MakeRowId(Axis, GetAxisRowIndex(Dimensions));
+	}
+
+	/** Return true if this row is valid and lies within a puzzle of the given dimensions */
+	FORCEINLINE bool IsWithinDimensions(const FIntVector& Dimensions) const
+	{
+		if (!IsValid())
+		{
+			return false;
+		}
+		int32 AxisA, AxisB;
+		GetOtherAxes(Axis, AxisA, AxisB);
+		return Position[AxisA] >= 0 && Position[AxisA] < Dimensions[AxisA] &&
+			Position[AxisB] >= 0 && Position[AxisB] < Dimensions[AxisB];
+	}
+
+	/** Return a packed row id from an axis and axis row index */
+	static FORCEINLINE int32 MakeRowId(int32 InAxis, int32 AxisRowIndex) { return (AxisRowIndex << 2) | InAxis; }
+
+	/** Return the axis of a packed row id */
+	static FORCEINLINE int32 GetRowIdAxis(int32 RowId) { return RowId & 3; }
+
+	/** Return the axis row index of a packed row id */
+	static FORCEINLINE int32 GetRowIdAxisRowIndex(int32 RowId) { return RowId >> 2; }
+
+	/** Return the row represented by a packed row id */
+	static FPuzzleRow FromRowId(int32 RowId, const FIntVector& Dimensions);
+
 	/**
 	 * Normalize the position of this row, ensuring that it represents
 	 * the starting position, and not some position in the middle of the row
@@ -151,7 +228,8 @@ struct PICROSS_API FPuzzleDef
 
 public:
 	FPuzzleDef()
-		: Dimensions(1, 5, 5)
+		: Dimensions(1, 5, 5),
+		  AnnotationSeed(0)
 	{
 	}
 
@@ -159,13 +237,109 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	FIntVector Dimensions;
 
-	/** The block definitions making up this puzzle */
+	/**
+	 * The block definitions making up this puzzle.
+	 * Change blocks with SetBlockType, or call UpdateBlockGrid after editing them directly.
+	 */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	TArray<FPuzzleBlockDef> Blocks;
-	
+
+	/** Seed used to decide annotation visibility, so the same puzzle always generates the same annotations */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	int32 AnnotationSeed;
+
+	/**
+	 * Rebuild the dense block grid from Blocks and Dimensions.
+	 * Must be called after modifying Blocks or Dimensions directly, otherwise lookups may return stale blocks.
+	 * Code that receives a puzzle from Blueprints or the editor should call this before using it.
+	 */
+	void UpdateBlockGrid();
+
+	/**
+	 * Return true if the dense block grid was built for the current dimensions and number of blocks.
+	 * Blocks that were retyped or moved in place are not detected, see UpdateBlockGrid.
+	 */
+	FORCEINLINE bool IsBlockGridValid() const
+	{
+		return BlockGridDimensions == Dimensions && BlockGridNumBlocks == Blocks.Num();
+	}
+
+	/** Return the total number of cells in the puzzle */
+	FORCEINLINE int32 GetNumCells() const { return Dimensions.X * Dimensions.Y * Dimensions.Z; }
+
+	/** Return true if a position is within the dimensions of the puzzle */
+	FORCEINLINE bool IsValidPosition(const FIntVector& Position) const
+	{
+		return Position.X >= 0 && Position.X < Dimensions.X &&
+			Position.Y >= 0 && Position.Y < Dimensions.Y &&
+			Position.Z >= 0 && Position.Z < Dimensions.Z;
+	}
+
+	/** Return the flat index of a cell within the puzzle (X-major, then Y, then Z) */
+	FORCEINLINE int32 GetCellIndex(const FIntVector& Position) const
+	{
+		return (Position.X * Dimensions.Y + Position.Y) * Dimensions.Z + Position.Z;
+	}
+
+	/** Return the position of a cell from its flat index */
+	FIntVector GetCellPosition(int32 CellIndex) const;
+
+	/** Return the difference in flat cell index between neighboring cells along an axis */
+	FORCEINLINE int32 GetCellStride(int32 Axis) const
+	{
+		return Axis == 0 ? Dimensions.Y * Dimensions.Z : Axis == 1 ? Dimensions.Z : 1;
+	}
+
+	/**
+	 * Return the type index of the block at a position, or 0 if there is no block.
+	 * Requires a valid block grid, see UpdateBlockGrid.
+	 */
+	FORCEINLINE uint8 GetBlockTypeIndexAtPosition(const FIntVector& Position) const
+	{
+		return IsValidPosition(Position) && IsBlockGridValid() ? BlockTypeGrid[GetCellIndex(Position)] : 0;
+	}
+
+	/** Return the type index of the block in a cell, or 0 if there is no block. Requires a valid block grid. */
+	FORCEINLINE uint8 GetBlockTypeIndexAtCell(int32 CellIndex) const { return BlockTypeGrid[CellIndex]; }
+
+	/** Return the block type for a type index, or an invalid tag for index 0 */
+	FORCEINLINE FGameplayTag GetBlockTypeFromIndex(uint8 TypeIndex) const
+	{
+		return TypeIndex > 0 && TypeIndex <= BlockTypes.Num() ? BlockTypes[TypeIndex - 1] : FGameplayTag();
+	}
+
+	/** Return the type index for a block type, or 0 if no block in the puzzle has that type */
+	uint8 FindBlockTypeIndex(FGameplayTag Type) const;
+
+	/** Return the unique block types used in this puzzle. Requires a valid block grid. */
+	FORCEINLINE const TArray<FGameplayTag>& GetBlockTypes() const { return BlockTypes; }
+
 	int32 GetBlockIndexAtPosition(FIntVector Position) const;
 
 	FPuzzleBlockDef GetBlockAtPosition(FIntVector Position) const;
+
+	/**
+	 * Set the type of the block at a position, adding a block def if there isn't one,
+	 * or removing it if the type is invalid. Keeps the block grid up to date.
+	 * @return True if the puzzle was changed
+	 */
+	bool SetBlockType(const FIntVector& Position, FGameplayTag NewType);
+
+private:
+	/** The dimensions that the block grid was built for */
+	FIntVector BlockGridDimensions = FIntVector::NoneValue;
+
+	/** The number of block defs that the block grid was built for */
+	int32 BlockGridNumBlocks = INDEX_NONE;
+
+	/** The type index of the block in each cell, 0 for no block, otherwise 1 + index into BlockTypes */
+	TArray<uint8> BlockTypeGrid;
+
+	/** The index into Blocks of the block def for each cell, INDEX_NONE for no block */
+	TArray<int32> BlockIndexGrid;
+
+	/** The unique block types in this puzzle, in order of first appearance in Blocks */
+	TArray<FGameplayTag> BlockTypes;
 };
 
 
@@ -225,6 +399,17 @@ public:
 	/** Have the blocks for this type been correctly identified? */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	bool bAreIdentified;
+
+	bool operator==(const FPuzzleRowTypeAnnotation& Other) const
+	{
+		return Type == Other.Type && NumBlocks == Other.NumBlocks && NumGroups == Other.NumGroups &&
+			bAreIdentified == Other.bAreIdentified;
+	}
+
+	bool operator!=(const FPuzzleRowTypeAnnotation& Other) const
+	{
+		return !operator==(Other);
+	}
 };
 
 
@@ -252,6 +437,16 @@ public:
 
 	/** Return true if this row has no blocks */
 	FORCEINLINE bool IsZeroAnnotation() const { return TypeAnnotations.Num() == 0; }
+
+	bool operator==(const FPuzzleRowAnnotations& Other) const
+	{
+		return bIsVisible == Other.bIsVisible && TypeAnnotations == Other.TypeAnnotations;
+	}
+
+	bool operator!=(const FPuzzleRowAnnotations& Other) const
+	{
+		return !operator==(Other);
+	}
 };
 
 
@@ -276,6 +471,23 @@ public:
 	/** Annotations for the Z row of this block */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	FPuzzleRowAnnotations ZAnnotations;
+
+	/** Return the annotations for the row of this block along an axis */
+	FORCEINLINE const FPuzzleRowAnnotations& GetAxisAnnotations(int32 Axis) const
+	{
+		return Axis == 0 ? XAnnotations : Axis == 1 ? YAnnotations : ZAnnotations;
+	}
+
+	bool operator==(const FPuzzleBlockAnnotations& Other) const
+	{
+		return XAnnotations == Other.XAnnotations && YAnnotations == Other.YAnnotations &&
+			ZAnnotations == Other.ZAnnotations;
+	}
+
+	bool operator!=(const FPuzzleBlockAnnotations& Other) const
+	{
+		return !operator==(Other);
+	}
 };
 
 
@@ -288,11 +500,50 @@ struct FPuzzleAnnotations
 	GENERATED_BODY()
 
 public:
-	/** Annotations for every row, indexed by row name */
+	FPuzzleAnnotations()
+		: Dimensions(FIntVector::ZeroValue)
+	{
+	}
+
+	/** The dimensions of the puzzle these annotations were generated for */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	FIntVector Dimensions;
+
+	/** Annotations for every row along the X axis, indexed by FPuzzleRow::GetAxisRowIndex */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	TArray<FPuzzleRowAnnotations> XRowAnnotations;
+
+	/** Annotations for every row along the Y axis, indexed by FPuzzleRow::GetAxisRowIndex */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
-	TMap<FString, FPuzzleRowAnnotations> RowAnnotations;
+	TArray<FPuzzleRowAnnotations> YRowAnnotations;
+
+	/** Annotations for every row along the Z axis, indexed by FPuzzleRow::GetAxisRowIndex */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	TArray<FPuzzleRowAnnotations> ZRowAnnotations;
 
 public:
+	/** Return the annotations for all rows along an axis */
+	FORCEINLINE TArray<FPuzzleRowAnnotations>& GetAxisRowAnnotations(int32 Axis)
+	{
+		return Axis == 0 ? XRowAnnotations : Axis == 1 ? YRowAnnotations : ZRowAnnotations;
+	}
+
+	FORCEINLINE const TArray<FPuzzleRowAnnotations>& GetAxisRowAnnotations(int32 Axis) const
+	{
+		return Axis == 0 ? XRowAnnotations : Axis == 1 ? YRowAnnotations : ZRowAnnotations;
+	}
+
+	/** Return the annotations for a row by packed row id, or null if the row is not valid */
+	FORCEINLINE const FPuzzleRowAnnotations* FindRowAnnotationsById(int32 RowId) const
+	{
+		const TArray<FPuzzleRowAnnotations>& AxisAnnotations = GetAxisRowAnnotations(FPuzzleRow::GetRowIdAxis(RowId));
+		const int32 RowIndex = FPuzzleRow::GetRowIdAxisRowIndex(RowId);
+		return AxisAnnotations.IsValidIndex(RowIndex) ? &AxisAnnotations[RowIndex] : nullptr;
+	}
+
+	/** Return the annotations for a row, or null if the row is not within the puzzle */
+	const FPuzzleRowAnnotations* FindRowAnnotations(FPuzzleRow Row) const;
+
 	/** Get annotations for a single block */
 	void GetBlockAnnotations(FIntVector Position, FPuzzleBlockAnnotations& OutBlockAnnotations) const;
 
@@ -313,24 +564,12 @@ public:
 	 * @param Row The row of the puzzle
 	 */
 	static FPuzzleRowAnnotations GenerateRowAnnotation(const FPuzzleDef& InPuzzle, FPuzzleRow Row);
-};
-
-
-/**
- * Puzzle solver used to both solve puzzles and provide information
- * needed to determine annotations based on puzzle difficulty
- */
-class PICROSS_API FPuzzleSolver
-{
-	/** The current puzzle being solved */
-	FPuzzle Puzzle;
-
-	/** The current annotations available to solve the puzzle */
-	FPuzzleAnnotations Annotations;
 
 	/**
-	 * Try to solve the whole puzzle with the current annotations.
-	 * @return True if the puzzle could be solved, false if the annotations did not provide enough information.
+	 * Return whether the annotations for a row with no blocks should be visible.
+	 * The result only depends on the seed and row, so it is the same every time.
+	 * @param Seed The annotation seed of the puzzle
+	 * @param RowId The packed row id of the row, see FPuzzleRow::GetRowId
 	 */
-	bool SolvePuzzle();
+	static bool IsZeroRowVisible(int32 Seed, int32 RowId);
 };